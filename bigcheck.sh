@@ -0,0 +1,58 @@
+#!/bin/sh
+# bigcheck.sh ... check a relation whose files go past 4GB
+# part of Multi-attribute linear-hashed files
+# Usage:  ./bigcheck.sh  [#tuples]
+# Builds relation BIG with 64K pages, after first making its ovflow
+#   file a 5GB hole (standing in for a relation that has already
+#   grown that big), so every overflow page it adds lies past 2^32
+#   bytes; then checks that lookups and dump find every tuple
+# The relation is built twice: by plain inserts, and by a bulk load
+# The hole is sparse, so this needs little disk space or time
+# Run by "make check"
+
+N=${1:-200000}
+R=BIG
+T=/tmp/bigcheck.$$
+
+fail()
+{
+	echo "FAIL: $1"
+	rm -f $R.* $T.*
+	exit 1
+}
+
+./gendata $N 4 > $T.in || fail "gendata"
+
+for mode in "" -b
+do
+	rm -f $R.*
+	./create -p 65536 -s chain:4 $R 4 1 "0,0:1,0:2,0:3,0:0,1:1,1:2,1:3,1" > /dev/null || fail "create"
+	truncate -s 5G $R.ovflow || fail "can't make the ovflow file sparse"
+	./insert $mode $R < $T.in || fail "insert $mode"
+
+	# the relation must really have pages past 4GB
+	size=`stat -c %s $R.ovflow`
+	[ "$size" -gt 5368709120 ] || fail "no overflow pages past the hole ($size bytes)"
+
+	# dump gives back exactly the tuples inserted
+	./dump $R | grep , | sort > $T.out
+	sort $T.in | cmp -s - $T.out || fail "dump differs from input"
+
+	# point lookups, on tuples spread through the input
+	for id in 1 2 `expr $N / 3` `expr $N / 2` `expr $N - 1` $N
+	do
+		want=`grep "^$id," $T.in`
+		got=`./select $R "$id,?,?,?" | grep ,`
+		[ "$got" = "$want" ] || fail "lookup of $id gave '$got'"
+	done
+
+	# a partial-match query agrees with a scan of the input
+	val=`sed -n 2p $T.in | cut -d, -f3`
+	grep "^[^,]*,[^,]*,$val," $T.in | sort > $T.want
+	./select $R "?,?,$val,?" | grep , | sort > $T.got
+	cmp -s $T.want $T.got || fail "query on attribute 2 = $val"
+
+	echo "OK: insert ${mode:-(plain)}, $N tuples, ovflow file $size bytes"
+done
+rm -f $R.* $T.*
+exit 0
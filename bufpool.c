@@ -0,0 +1,368 @@
+// bufpool.c ... per-relation buffer pool
+// part of Multi-attribute Linear-hashed Files
+// Caches pages from a relation's files in a fixed set of frames
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "defs.h"
+#include "bufpool.h"
+#include "page.h"
+#include "wal.h"
+
+#define NO_FRAME (-1)
+#define MAXMAPS  2
+
+// A BufPool is a fixed array of frames, each the size of a page
+//   of the relation it belongs to
+// - frames are identified by (file,pid) and found via a hash table
+// - pinned frames are never evicted
+// - replacement uses the clock algorithm over the usage bits
+// - dirty frames are written back at eviction or at flush time
+// Files opened read-only may instead be mapped into memory
+// - pages from a mapped file are pointers into the mapping
+// - they bypass the frames entirely, and pin/unpin cost nothing
+// - they are counted apart from hits and misses, which are only
+//   about the frames
+// - the mapping is re-created if a page beyond its end is requested
+// A pool may be shared by several threads; a single lock
+//   protects the frame table, mappings and counters
+// - a page is read into its frame without the lock; the frame is
+//   pinned and marked busy meanwhile, and anyone else wanting the
+//   page waits for the read to finish
+// - a dirty victim is written back the same way, still holding its
+//   old page; if someone wants that page meanwhile, it stays, and
+//   another victim is found
+// - flushing pins each dirty frame and writes it without the lock;
+//   it first waits for any eviction under way, so that every page
+//   dirtied before a flush has been written when the flush returns
+// - writers of a page must arrange between themselves (e.g. by
+//   bucket latches) that no one else uses it at the same time
+// A pool may have a write-ahead log, in which case dirty pages are
+//   written back to the log rather than to their files, and pages
+//   are read from the log if it has them
+
+typedef struct {
+	FILE  *file;   // file the page came from (NULL if frame unused)
+	PageID pid;    // page id within file
+	Count  pins;   // number of active users
+	Bool   used;   // usage bit for clock replacement
+	Bool   dirty;  // modified since read
+	Bool   busy;   // page being read in
+	int    next;   // next frame in hash chain
+} Frame;
+
+typedef struct {
+	FILE  *file;   // mapped file
+	char  *base;   // start of mapping (NULL if file empty)
+	size_t len;    // bytes currently mapped
+	Count  nold;   // earlier mappings, kept until the pool is freed
+	char **old;    //   since other threads may still use their pages
+	size_t *oldlen;
+} MapFile;
+
+struct BufPoolRep {
+	Count  nbufs;  // number of frames
+	Count  pagesize; // bytes in each frame
+	char  *mem;    // nbufs*pagesize bytes of page buffers
+	Frame *frames; // per-frame control info
+	int   *table;  // hash table of frame chains
+	Count  nslots; // size of hash table
+	Count  clock;  // clock hand
+	Count  hits;   // requests satisfied from pool
+	Count  misses; // requests needing a read
+	Count  mapped; // requests served from a mapped file
+	Count  nmaps;  // number of mapped files
+	MapFile maps[MAXMAPS];
+	WAL    wal;    // log for dirty pages (NULL if none)
+	pthread_mutex_t lock;
+	pthread_cond_t  loaded; // a busy frame has been read in
+};
+
+static Count slotOf(BufPool pool, FILE *f, PageID pid)
+{
+	unsigned long h = (unsigned long)f ^ (pid * 2654435761u);
+	return h % pool->nslots;
+}
+
+static Page frameData(BufPool pool, int i)
+{
+	return (Page)(pool->mem + (size_t)i*pool->pagesize);
+}
+
+// create a pool with nbufs empty frames for pages of pagesize bytes
+
+BufPool newBufPool(Count nbufs, Count pagesize)
+{
+	assert(nbufs > 0);
+	BufPool pool = malloc(sizeof(struct BufPoolRep));
+	assert(pool != NULL);
+	pool->nbufs = nbufs;
+	pool->pagesize = pagesize;
+	pool->mem = malloc((size_t)nbufs*pagesize);
+	pool->frames = malloc(nbufs*sizeof(Frame));
+	pool->nslots = 2*nbufs;
+	pool->table = malloc(pool->nslots*sizeof(int));
+	assert(pool->mem != NULL && pool->frames != NULL && pool->table != NULL);
+	for (int i = 0; i < nbufs; i++) {
+		Frame *fr = &pool->frames[i];
+		fr->file = NULL; fr->pid = NO_PAGE; fr->pins = 0;
+		fr->used = FALSE; fr->dirty = FALSE; fr->busy = FALSE;
+		fr->next = NO_FRAME;
+	}
+	for (int i = 0; i < pool->nslots; i++) pool->table[i] = NO_FRAME;
+	pool->clock = 0;
+	pool->hits = pool->misses = pool->mapped = 0;
+	pool->nmaps = 0;
+	pool->wal = NULL;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->loaded, NULL);
+	return pool;
+}
+
+// write back dirty frames and release the pool
+
+void freeBufPool(BufPool pool)
+{
+	flushBufPool(pool);
+	for (int i = 0; i < pool->nmaps; i++) {
+		MapFile *m = &pool->maps[i];
+		if (m->base != NULL) munmap(m->base, m->len);
+		for (Count j = 0; j < m->nold; j++) munmap(m->old[j], m->oldlen[j]);
+		free(m->old); free(m->oldlen);
+	}
+	free(pool->mem);
+	free(pool->frames);
+	free(pool->table);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->loaded);
+	free(pool);
+}
+
+// write a dirty frame back, to the log if there is one
+
+static void writeFrame(BufPool pool, int i)
+{
+	Frame *fr = &pool->frames[i];
+	if (pool->wal != NULL)
+		logPage(pool->wal, fr->file, fr->pid, frameData(pool,i));
+	else
+		writePage(fr->file, fr->pid, frameData(pool,i), pool->pagesize);
+}
+
+static void unhashFrame(BufPool pool, int i)
+{
+	Frame *fr = &pool->frames[i];
+	int *link = &pool->table[slotOf(pool, fr->file, fr->pid)];
+	while (*link != i) link = &pool->frames[*link].next;
+	*link = fr->next;
+	fr->next = NO_FRAME;
+}
+
+// choose a frame to hold a new page, writing back its old contents
+// returns an empty frame; caller holds the lock, which is dropped
+//   while a dirty victim is written back
+
+static int grabFrame(BufPool pool)
+{
+	// two full sweeps clear every usage bit, so a third finds
+	// a victim unless every frame is pinned
+	for (Count n = 0; n < 3*pool->nbufs; n++) {
+		int i = pool->clock;
+		pool->clock = (pool->clock+1) % pool->nbufs;
+		Frame *fr = &pool->frames[i];
+		if (fr->pins > 0) continue;
+		if (fr->used) { fr->used = FALSE; continue; }
+		if (fr->file != NULL && fr->dirty) {
+			fr->pins++;
+			fr->busy = TRUE;
+			pthread_mutex_unlock(&pool->lock);
+			writeFrame(pool, i);
+			pthread_mutex_lock(&pool->lock);
+			fr->dirty = FALSE;
+			fr->busy = FALSE;
+			fr->pins--;
+			pthread_cond_broadcast(&pool->loaded);
+			// the frames have changed meanwhile; start counting again
+			n = 0;
+			if (fr->pins > 0 || fr->used) continue;
+		}
+		if (fr->file != NULL) {
+			unhashFrame(pool, i);
+			fr->file = NULL; fr->pid = NO_PAGE;
+		}
+		return i;
+	}
+	fatal("Buffer pool: all frames are pinned");
+	return NO_FRAME;
+}
+
+// (re)map the whole of a file read-only
+
+static void remapFile(MapFile *m, Count pagesize)
+{
+	struct stat st;
+	int ok = fstat(fileno(m->file), &st);
+	assert(ok == 0);
+	if (m->base != NULL) {
+		m->old = realloc(m->old, (m->nold+1)*sizeof(char *));
+		m->oldlen = realloc(m->oldlen, (m->nold+1)*sizeof(size_t));
+		assert(m->old != NULL && m->oldlen != NULL);
+		m->old[m->nold] = m->base;
+		m->oldlen[m->nold++] = m->len;
+	}
+	m->base = NULL;
+	m->len = st.st_size - st.st_size%pagesize;
+	if (m->len == 0) return;
+	m->base = mmap(NULL, m->len, PROT_READ, MAP_SHARED, fileno(m->file), 0);
+	if (m->base == MAP_FAILED) fatal("Can't map relation file");
+}
+
+// serve pages of a read-only file directly from a mapping
+
+void mapPoolFile(BufPool pool, FILE *f)
+{
+	assert(pool->nmaps < MAXMAPS);
+	MapFile *m = &pool->maps[pool->nmaps++];
+	m->file = f;
+	m->base = NULL;
+	m->len = 0;
+	m->nold = 0; m->old = NULL; m->oldlen = NULL;
+	remapFile(m, pool->pagesize);
+}
+
+static MapFile *findMap(BufPool pool, FILE *f)
+{
+	for (int i = 0; i < pool->nmaps; i++)
+		if (pool->maps[i].file == f) return &pool->maps[i];
+	return NULL;
+}
+
+// return a pinned buffer holding page pid of file f
+// caller must unpinPage() it when finished
+
+Page pinPage(BufPool pool, FILE *f, PageID pid)
+{
+	Page p;
+	pthread_mutex_lock(&pool->lock);
+	MapFile *m = findMap(pool, f);
+	if (m != NULL) {
+		size_t end = (size_t)pid*pool->pagesize + pool->pagesize;
+		// file may have grown since it was mapped
+		if (end > m->len) remapFile(m, pool->pagesize);
+		assert(end <= m->len);
+		pool->mapped++;
+		p = (Page)(m->base + (size_t)pid*pool->pagesize);
+		pthread_mutex_unlock(&pool->lock);
+		return p;
+	}
+	Count slot = slotOf(pool, f, pid);
+	int i = NO_FRAME;
+	for (;;) {
+		int j;
+		for (j = pool->table[slot]; j != NO_FRAME; j = pool->frames[j].next) {
+			Frame *fr = &pool->frames[j];
+			if (fr->file == f && fr->pid == pid) break;
+		}
+		if (j != NO_FRAME) {
+			// any frame grabbed already is left empty
+			Frame *fr = &pool->frames[j];
+			fr->pins++;
+			fr->used = TRUE;
+			pool->hits++;
+			while (fr->busy) pthread_cond_wait(&pool->loaded, &pool->lock);
+			p = frameData(pool, j);
+			pthread_mutex_unlock(&pool->lock);
+			return p;
+		}
+		if (i != NO_FRAME) break;
+		// the lock may be dropped to write back a victim, so the
+		//   page may have been brought in meanwhile; look again
+		i = grabFrame(pool);
+	}
+	pool->misses++;
+	Frame *fr = &pool->frames[i];
+	fr->file = f; fr->pid = pid; fr->pins = 1;
+	fr->used = TRUE; fr->dirty = FALSE; fr->busy = TRUE;
+	fr->next = pool->table[slot];
+	pool->table[slot] = i;
+	pthread_mutex_unlock(&pool->lock);
+	p = frameData(pool, i);
+	if (pool->wal == NULL || !loggedPage(pool->wal, f, pid, p))
+		readPage(f, pid, p, pool->pagesize);
+	pthread_mutex_lock(&pool->lock);
+	fr->busy = FALSE;
+	pthread_cond_broadcast(&pool->loaded);
+	pthread_mutex_unlock(&pool->lock);
+	return p;
+}
+
+// release a pinned page; dirty pages are written back lazily
+
+void unpinPage(BufPool pool, Page p, Bool dirty)
+{
+	char *c = (char *)p;
+	if (c < pool->mem || c >= pool->mem + (size_t)pool->nbufs*pool->pagesize) {
+		// page lives in a read-only mapping
+		assert(!dirty);
+		return;
+	}
+	int i = (c - pool->mem) / pool->pagesize;
+	pthread_mutex_lock(&pool->lock);
+	Frame *fr = &pool->frames[i];
+	assert(fr->pins > 0);
+	fr->pins--;
+	if (dirty) fr->dirty = TRUE;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// write all dirty frames back to their files
+
+void flushBufPool(BufPool pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->nbufs; i++) {
+		Frame *fr = &pool->frames[i];
+		while (fr->busy) pthread_cond_wait(&pool->loaded, &pool->lock);
+		if (fr->file == NULL || !fr->dirty) continue;
+		fr->pins++;
+		fr->dirty = FALSE;
+		pthread_mutex_unlock(&pool->lock);
+		writeFrame(pool, i);
+		pthread_mutex_lock(&pool->lock);
+		fr->pins--;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// write back dirty frames and forget all cached pages
+// used when pages are rewritten behind the pool's back
+
+void resetBufPool(BufPool pool)
+{
+	flushBufPool(pool);
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->nbufs; i++) {
+		Frame *fr = &pool->frames[i];
+		assert(fr->pins == 0);
+		fr->file = NULL; fr->pid = NO_PAGE;
+		fr->used = FALSE; fr->next = NO_FRAME;
+	}
+	for (int i = 0; i < pool->nslots; i++) pool->table[i] = NO_FRAME;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// send dirty pages to a log from now on (or, if wal is NULL,
+//   back to their files)
+
+void setPoolWAL(BufPool pool, WAL wal)
+{
+	pool->wal = wal;
+}
+
+// pool statistics
+
+Count poolSize(BufPool pool) { return pool->nbufs; }
+Count poolHits(BufPool pool) { return pool->hits; }
+Count poolMisses(BufPool pool) { return pool->misses; }
+Count poolMapped(BufPool pool) { return pool->mapped; }
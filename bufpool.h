@@ -0,0 +1,27 @@
+// bufpool.h ... interface to per-relation buffer pool
+// part of Multi-attribute Linear-hashed Files
+// See bufpool.c for details of BufPool type and functions
+
+#ifndef BUFPOOL_H
+#define BUFPOOL_H 1
+
+typedef struct BufPoolRep *BufPool;
+
+#include "defs.h"
+#include "page.h"
+#include "wal.h"
+
+BufPool newBufPool(Count nbufs, Count pagesize);
+void freeBufPool(BufPool pool);
+void mapPoolFile(BufPool pool, FILE *f);
+Page pinPage(BufPool pool, FILE *f, PageID pid);
+void unpinPage(BufPool pool, Page p, Bool dirty);
+void flushBufPool(BufPool pool);
+void resetBufPool(BufPool pool);
+void setPoolWAL(BufPool pool, WAL wal);
+Count poolSize(BufPool pool);
+Count poolHits(BufPool pool);
+Count poolMisses(BufPool pool);
+Count poolMapped(BufPool pool);
+
+#endif
@@ -40,7 +40,6 @@ Status parseChVec(Reln r, char *str, ChVec cv)
 			*c = ':'; c++; c0 = c;
 		}
 		cv[i].att = a; cv[i].bit = b;
-		printf("cv[%d] is (%d,%d)\n", i, cv[i].att, cv[i].bit);
 		i++;
 	}
 	// get enough bits for a 32-bit choice vector
@@ -51,7 +50,6 @@ Status parseChVec(Reln r, char *str, ChVec cv)
 	x = 0;
 	while (i < MAXCHVEC) {
 		cv[i].att = x; cv[i].bit = next[x];
-		printf("cv[%d] is (%d,%d)\n", i, cv[i].att, cv[i].bit);
 		next[x]--;
 		i++; x = (x+1) % nattr;
 	}
@@ -69,3 +67,191 @@ void printChVec(ChVec cv)
 	}
 	printf("\n");
 }
+
+// A ChVecPlan computes the composite hash from the per-attribute
+//   hashes without visiting the choice vector bit by bit
+// It holds two equivalent forms of the choice vector:
+// - lookup tables, one per (attribute, source byte) in use,
+//   mapping each byte value to the output bits it sets
+// - PEXT/PDEP steps, each gathering a set of source bits from
+//   one attribute hash and depositing them in the output;
+//   a step needs source and output positions in the same order,
+//   so steps with opposite orders deposit into a bit-reversed
+//   output, which is flipped once at the end
+// The steps are used when the CPU has BMI2 and they need fewer
+//   operations than the tables; measured per-hash costs are
+//   otherwise similar or in favour of the tables (see hashbench)
+
+typedef struct {
+	Byte att;    // attribute whose hash supplies the bits
+	Byte rev;    // deposit into the bit-reversed output?
+	Bits src;    // source bit positions
+	Bits dst;    // output bit positions (reversed if rev)
+} PlanStep;
+
+typedef struct {
+	Byte att;    // attribute whose hash supplies the byte
+	Byte shift;  // position of the byte in the hash
+	Bits out[256];
+} PlanTable;
+
+struct ChVecPlanRep {
+	Count nsteps;
+	PlanStep steps[MAXCHVEC];
+	Count ntables;
+	PlanTable *tables;
+	Bits (*combine)(ChVecPlan, Bits *);
+};
+
+static Bits reverseBits(Bits x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// split one attribute's (bit -> output) pairs into order-preserving
+//   steps; pairs arrive in increasing output order, and each goes in
+//   the first step whose last source position is below its own
+// returns the number of steps used
+
+static Count planSteps(ChVec cv, Byte att, Byte rev, PlanStep *steps)
+{
+	Count n = 0;
+	int last[MAXCHVEC];
+	for (int i = 0; i < MAXCHVEC; i++) {
+		if (cv[i].att != att) continue;
+		int pos = rev ? 31 - cv[i].bit : cv[i].bit;
+		Count s = 0;
+		while (s < n && last[s] >= pos) s++;
+		if (s == n) {
+			steps[n].att = att; steps[n].rev = rev;
+			steps[n].src = steps[n].dst = 0;
+			n++;
+		}
+		steps[s].src = setBit(steps[s].src, cv[i].bit);
+		steps[s].dst = setBit(steps[s].dst, rev ? 31 - i : i);
+		last[s] = pos;
+	}
+	return n;
+}
+
+ChVecPlan compileChVec(ChVec cv)
+{
+	ChVecPlan p = malloc(sizeof(struct ChVecPlanRep));
+	assert(p != NULL);
+
+	// lookup tables for every (attribute, byte) that supplies bits
+	p->ntables = 0;
+	p->tables = malloc(MAXCHVEC*sizeof(PlanTable));
+	assert(p->tables != NULL);
+	for (int i = 0; i < MAXCHVEC; i++) {
+		Byte att = cv[i].att, shift = cv[i].bit & ~7;
+		Count t;
+		for (t = 0; t < p->ntables; t++)
+			if (p->tables[t].att == att && p->tables[t].shift == shift) break;
+		if (t < p->ntables) continue;
+		PlanTable *tab = &p->tables[p->ntables++];
+		tab->att = att; tab->shift = shift;
+		for (int v = 0; v < 256; v++) {
+			Bits out = 0;
+			for (int j = 0; j < MAXCHVEC; j++) {
+				if (cv[j].att != att || (cv[j].bit & ~7) != shift) continue;
+				if (bitIsSet(v, cv[j].bit - shift)) out = setBit(out, j);
+			}
+			tab->out[v] = out;
+		}
+	}
+
+	// PEXT/PDEP steps, choosing the cheaper bit order per attribute
+	p->nsteps = 0;
+	for (int att = 0; att < 256; att++) {
+		PlanStep fwd[MAXCHVEC], rev[MAXCHVEC];
+		Count nf = planSteps(cv, att, 0, fwd);
+		if (nf == 0) continue;
+		Count nr = planSteps(cv, att, 1, rev);
+		PlanStep *best = (nr < nf) ? rev : fwd;
+		Count nb = (nr < nf) ? nr : nf;
+		memcpy(&p->steps[p->nsteps], best, nb*sizeof(PlanStep));
+		p->nsteps += nb;
+	}
+
+	if (havePext() && p->nsteps < p->ntables)
+		p->combine = chvecHashPext;
+	else
+		p->combine = chvecHashTable;
+	return p;
+}
+
+void freeChVecPlan(ChVecPlan p)
+{
+	free(p->tables);
+	free(p);
+}
+
+// composite hash from per-attribute hashes, best available method
+
+Bits chvecHash(ChVecPlan p, Bits *attrHash)
+{
+	return p->combine(p, attrHash);
+}
+
+// reference version: output bit i is bit cv[i].bit of attribute cv[i].att
+
+Bits chvecHashRef(ChVec cv, Bits *attrHash)
+{
+	Bits result = 0;
+	for (int i = 0; i < MAXCHVEC; i++)
+		if (bitIsSet(attrHash[cv[i].att], cv[i].bit))
+			result = setBit(result, i);
+	return result;
+}
+
+// portable version: one table lookup per source byte
+
+Bits chvecHashTable(ChVecPlan p, Bits *attrHash)
+{
+	Bits result = 0;
+	for (Count t = 0; t < p->ntables; t++) {
+		PlanTable *tab = &p->tables[t];
+		result |= tab->out[(attrHash[tab->att] >> tab->shift) & 0xff];
+	}
+	return result;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+// BMI2 version: one PEXT/PDEP pair per step
+
+__attribute__((target("bmi2")))
+Bits chvecHashPext(ChVecPlan p, Bits *attrHash)
+{
+	Bits result = 0, reversed = 0;
+	for (Count s = 0; s < p->nsteps; s++) {
+		PlanStep *st = &p->steps[s];
+		Bits bits = _pdep_u32(_pext_u32(attrHash[st->att], st->src), st->dst);
+		if (st->rev) reversed |= bits; else result |= bits;
+	}
+	return reversed ? result | reverseBits(reversed) : result;
+}
+
+Bool havePext()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("bmi2") != 0;
+}
+
+#else
+
+Bits chvecHashPext(ChVecPlan p, Bits *attrHash)
+{
+	return chvecHashTable(p, attrHash);
+}
+
+Bool havePext() { return FALSE; }
+
+#endif
@@ -10,6 +10,7 @@
 
 #include "defs.h"
 #include "reln.h"
+#include "bits.h"
 
 #define MAXCHVEC 32
 
@@ -17,7 +18,17 @@ typedef struct _ChVecItem { Byte att; Byte bit; } ChVecItem;
 
 typedef ChVecItem ChVec[MAXCHVEC];
 
+// a ChVec compiled into bit-gather steps (see chvec.c)
+typedef struct ChVecPlanRep *ChVecPlan;
+
 Status parseChVec(Reln r, char *str, ChVec cv);
 void printChVec(ChVec cv);
+ChVecPlan compileChVec(ChVec cv);
+void freeChVecPlan(ChVecPlan p);
+Bits chvecHash(ChVecPlan p, Bits *attrHash);
+Bits chvecHashRef(ChVec cv, Bits *attrHash);
+Bits chvecHashTable(ChVecPlan p, Bits *attrHash);
+Bits chvecHashPext(ChVecPlan p, Bits *attrHash);
+Bool havePext();
 
 #endif
@@ -1,10 +1,26 @@
 // create.c ... create an empty Relation
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named file
-// Usage:  ./create  [-v]  RelName  #attrs  #pages  ChoiceVector
+// Usage:  ./create  [-v]  [-f Format]  [-p PageSize]  [-s Policy]  [-d Attrs]  [-t Schema]  RelName  #attrs  #pages  ChoiceVector
 // where #attrs = # of attributes in each tuple
 //	   #pages = initial (empty) pages in File
 //	   ChoiceVector = attr,bit:attr,bit:...
+// -f chooses the page format (default packed):
+//    packed   tuples back to back
+//    slotted  tuples plus a slot directory
+//    signed   slotted, plus a signature of the values in the page
+//    hashed   signed, plus each tuple's hash in its slot
+// -p chooses the page size in bytes: a power of two from 1024 to
+//    65536 (default 1024); a K suffix counts in kilobytes
+// -s chooses when to split buckets (default every):
+//    every[:N]  after every N insertions
+//    load[:P]   when tuples fill more than P% of the primary pages
+//    chain[:L]  when a bucket gets more than L overflow pages
+// -d stores the values of some attributes as dictionary codes,
+//    for attributes with few distinct values; Attrs is a list of
+//    attribute numbers and ranges (e.g. 1,3-5), or "all"
+// -t gives the type of each attribute, int or str (e.g. int,str,str);
+//    ints are stored in binary, and can't also be dictionary-encoded
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -12,8 +28,57 @@
 #include "util.h"
 #include "reln.h"
 
-#define USAGE "./create  [-v]  RelName  #attrs  #pages  ChoiceVector"
+#define MAXINITPAGES (1<<24)  // largest initial #pages
 
+#define USAGE "./create  [-v]  [-f packed|slotted|signed|hashed]  [-p PageSize]  [-s every|load|chain[:N]]  [-d Attrs]  [-t Schema]  RelName  #attrs  #pages  ChoiceVector"
+
+// parse a list of attributes to encode, for a relation with
+//   nattrs attributes; returns FALSE if it is not valid
+
+static Bool parseAttrs(char *list, int nattrs, Bits *attrs)
+{
+	*attrs = 0;
+	if (strcmp(list, "all") == 0) {
+		for (int i = 0; i < nattrs; i++) *attrs = setBit(*attrs, i);
+		return TRUE;
+	}
+	char *c = list;
+	while (*c != '\0') {
+		char *end;
+		long lo = strtol(c, &end, 10), hi = lo;
+		if (end == c) return FALSE;
+		if (*end == '-') {
+			c = end+1;
+			hi = strtol(c, &end, 10);
+			if (end == c) return FALSE;
+		}
+		if (lo < 0 || lo > hi || hi >= nattrs) return FALSE;
+		for (long i = lo; i <= hi; i++) *attrs = setBit(*attrs, i);
+		if (*end == ',') end++;
+		else if (*end != '\0') return FALSE;
+		c = end;
+	}
+	return TRUE;
+}
+
+// parse a schema, a type (int or str) for each of nattrs
+//   attributes; returns FALSE if it is not valid
+
+static Bool parseSchema(char *schema, int nattrs, Bits *ints)
+{
+	*ints = 0;
+	char *c = schema;
+	for (int i = 0; i < nattrs; i++) {
+		Count len = strcspn(c, ",");
+		if (len == 3 && strncmp(c, "int", 3) == 0)
+			*ints = setBit(*ints, i);
+		else if (len != 3 || strncmp(c, "str", 3) != 0)
+			return FALSE;
+		c += len;
+		if (*c == ',' && i+1 < nattrs) c++;
+	}
+	return *c == '\0';
+}
 
 // Main ... process args, create relation
 
@@ -23,35 +88,89 @@ int main(int argc, char **argv)
 	int nattrs;  // number of attributes in each tuple
 	int npages;  // initial number of pages
 	char err[MAXERRMSG];  // buffer for error messages
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
+	PageFormat format = PACKED_PAGES;  // layout of pages
+	int pagesize = DEFPAGESIZE;  // bytes in each page
+	int policy = SPLIT_EVERY;  // when to split
+	int param = -1;  // setting for split policy (-1 = usual)
 	char *rname;  // name of table/file
 	char *attrs;   // number of attributes in tuples
 	char *pages;   // number of pages in data file
 	char *cv;	  // choice vector
+	char *dlist = NULL;  // attributes to encode
+	Bits dictattrs = 0;  // ... as a set
+	char *schema = NULL;  // attribute types
+	Bits intattrs = 0;  // attributes that are ints
 
 	// Process command-line args
 
-	if (argc < 2) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		if (argc < 6) fatal(USAGE);
-	    verbose = 1; rname = argv[2]; attrs = argv[3]; pages = argv[4]; cv = argv[5];
-	}
-	else {
-		if (argc < 5) fatal(USAGE);
-	    verbose = 0; rname = argv[1]; attrs = argv[2]; pages = argv[3]; cv = argv[4];
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[a], "-f") == 0 && a+1 < argc) {
+			if ((format = parseFormat(argv[++a])) == 0) fatal(USAGE);
+		}
+		else if (strcmp(argv[a], "-p") == 0 && a+1 < argc) {
+			a++;
+			char *end;
+			pagesize = strtol(argv[a], &end, 10);
+			if (*end == 'K' || *end == 'k') { pagesize *= 1024; end++; }
+			if (*end != '\0' || pagesize < 0 || !validPageSize(pagesize)) {
+				sprintf(err, "Invalid page size: %s (must be a power of 2, %d..%d)",
+				        argv[a], MINPAGESIZE, MAXPAGESIZE);
+				fatal(err);
+			}
+		}
+		else if (strcmp(argv[a], "-s") == 0 && a+1 < argc) {
+			a++;
+			char *n = strchr(argv[a], ':');
+			Count len = (n == NULL) ? strlen(argv[a]) : n - argv[a];
+			if (strncmp(argv[a], "every", len) == 0 && len == 5)
+				policy = SPLIT_EVERY;
+			else if (strncmp(argv[a], "load", len) == 0 && len == 4)
+				policy = SPLIT_LOAD;
+			else if (strncmp(argv[a], "chain", len) == 0 && len == 5)
+				policy = SPLIT_CHAIN;
+			else
+				fatal(USAGE);
+			if (n != NULL) {
+				param = atoi(n+1);
+				// chains may be limited to no overflow pages at all
+				if (param < (policy == SPLIT_CHAIN ? 0 : 1)) fatal(USAGE);
+			}
+		}
+		else if (strcmp(argv[a], "-d") == 0 && a+1 < argc)
+			dlist = argv[++a];
+		else if (strcmp(argv[a], "-t") == 0 && a+1 < argc)
+			schema = argv[++a];
+		else
+			fatal(USAGE);
 	}
+	if (a+4 > argc) fatal(USAGE);
+	rname = argv[a]; attrs = argv[a+1]; pages = argv[a+2]; cv = argv[a+3];
 
 	// how many attributes in each tuple
 	nattrs = atoi(attrs);
-	if (nattrs < 2 || nattrs > 10) {
-		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 11)", nattrs);
+	if (nattrs < 2 || nattrs > MAXATTRS) {
+		sprintf(err, "Invalid #attrs: %d (must be 1 < # <= %d)", nattrs, MAXATTRS);
 		fatal(err);
 	}
 
+	if (dlist != NULL && !parseAttrs(dlist, nattrs, &dictattrs)) {
+		sprintf(err, "Invalid attribute list: %s (attributes are 0..%d)", dlist, nattrs-1);
+		fatal(err);
+	}
+	if (schema != NULL && !parseSchema(schema, nattrs, &intattrs)) {
+		sprintf(err, "Invalid schema: %s (must be %d of int or str)", schema, nattrs);
+		fatal(err);
+	}
+	if ((intattrs & dictattrs) != 0) fatal("Int attributes can't be dictionary-encoded");
+
 	// how many initally empty pages
 	npages = atoi(pages);
-	if (npages < 1 || npages > 64) {
-		sprintf(err, "Invalid #pages: %d (must be 0 < # < 65)", nattrs);
+	if (npages < 1 || npages > MAXINITPAGES) {
+		sprintf(err, "Invalid #pages: %d (must be 0 < # <= %d)", npages, MAXINITPAGES);
 		fatal(err);
 	}
 	// convert to least 2^d >= npages
@@ -59,8 +178,18 @@ int main(int argc, char **argv)
 	int d = 0, np = 1;
 	while (np < npages) { d++; np <<= 1; }
 
+	if (param < 0) {
+		param = defaultSplitParam(policy, nattrs, format, pagesize);
+		// encoded values are mostly one or two bytes, not ten or
+		//   so, so more tuples fit in a page between splits
+		if (policy == SPLIT_EVERY && dictattrs != 0) {
+			int ncoded = 0;
+			for (int i = 0; i < nattrs; i++) ncoded += bitIsSet(dictattrs, i);
+			param = param*10*nattrs/(10*(nattrs-ncoded) + 3*ncoded);
+		}
+	}
 	if (verbose)
-		printf("#a=%d, #p=%d, d=%d\n", nattrs, np, d);
+		printf("#a=%d, #p=%d, d=%d, pagesize=%d\n", nattrs, np, d, pagesize);
 
 	// Open files for the Relation and initialise
 
@@ -68,9 +197,16 @@ int main(int argc, char **argv)
 		sprintf(err, "Relation %s already exists", rname);
 		fatal(err);
 	}
-	if (newRelation(rname, nattrs, np, d, cv) != OK) {
+	if (newRelation(rname, nattrs, np, d, cv, format, pagesize, policy, param, intattrs, dictattrs) != OK) {
 		sprintf(err, "Problems while creating relation %s", rname);
 		fatal(err);
 	}
+	if (verbose) {
+		// the full choice vector, with the bits filled in for it
+		Reln r = openRelation(rname, "r");
+		printf("Choice vector: ");
+		printChVec(chvec(r));
+		closeRelation(r);
+	}
 	return OK;
 }
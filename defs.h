@@ -12,13 +12,17 @@
 #include <assert.h>
 #include "util.h"
 
-#define PAGESIZE    1024
+#define DEFPAGESIZE 1024   // page size of new relations, unless chosen
+#define MINPAGESIZE 1024
+#define MAXPAGESIZE 65536
 #define NO_PAGE     0xffffffff
 #define MAXERRMSG   200
-#define MAXTUPLEN   200
+#define MAXTUPLEN   512
+#define MAXATTRS    32
 #define MAXRELNAME  200
 #define MAXFILENAME MAXRELNAME+8
 #define MAXBITS     32
+#define NBUFS       64
 #define OK          0
 #define TRUE        1
 #define FALSE       0
@@ -28,6 +32,7 @@ typedef unsigned char Byte;
 typedef int Status;
 typedef unsigned int Offset;
 typedef unsigned int Count;
+typedef unsigned long long BigCount;  // tuples and bytes in a relation
 typedef Offset PageID;
 
 #endif
@@ -0,0 +1,281 @@
+// dict.c ... a relation's value dictionaries
+// part of Multi-attribute Linear-hashed Files
+// Map attribute values to short codes, kept in rel.dict
+
+#include <unistd.h>
+#include <pthread.h>
+#include "defs.h"
+#include "dict.h"
+#include "tuple.h"
+#include "hash.h"
+
+// A relation may have some of its attributes dictionary-encoded
+// - each such attribute has its own dictionary, which gives every
+//   distinct value a code: 0 for the first value seen, 1 for the
+//   next, and so on
+// - tuples are stored with the code of each encoded value in place
+//   of the value itself; other attributes are left as they are
+// - a code is written as a varint of 6-bit groups, most significant
+//   first: 0xC0|bits for all but the last byte, 0x80|bits for the
+//   last; codes under 64 take one byte, under 4096 two, ...
+// - since every byte of a code is 0x80 or more, a code never holds
+//   a ',' or a '\0', so encoded tuples are still strings of comma-
+//   separated fields, and pages, splits and scans handle them just
+//   as they handle plain tuples
+// - tuple hashes, page signatures and query matching all work on
+//   the codes; a query has its known values encoded once, and only
+//   tuples being shown to the user are decoded
+// rel.dict holds each attribute's values in code order, as a log
+//   of (attribute, length, bytes) records; a value is added to the
+//   log (and flushed) before any tuple holding its code is stored,
+//   and synced before any commit of the relation's log (see wal.c)
+// - a record cut short by a crash is dropped when the file is
+//   next opened for writing
+
+typedef struct {
+	Count  att, len;
+} DictRec;
+
+typedef struct {
+	char **vals;   // value of each code
+	Count *lens;   // ... and its length
+	Count  n, max; // codes given out, room in vals/lens
+	Count *table;  // hash table of code+1 (0 for empty)
+	Count  nslots; // size of table (a power of 2)
+} AttrDict;
+
+struct DictRep {
+	FILE  *file;   // handle on rel.dict
+	Bits   attrs;  // attributes that are encoded
+	AttrDict dicts[MAXATTRS];
+	pthread_mutex_t lock; // held while coding values
+};
+
+#define MAXCODELEN 6  // bytes in the longest code
+
+// create an empty dictionary file for relation name
+
+Status newDict(char *name)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.dict",name);
+	FILE *f = fopen(fname,"w");
+	if (f == NULL) return ~OK;
+	fclose(f);
+	return OK;
+}
+
+static Count valueSlot(AttrDict *ad, char *val, Count len)
+{
+	return hash_any((unsigned char *)val, len) & (ad->nslots-1);
+}
+
+// the code of a value, or NO_PAGE if it has none
+
+static Count findValue(AttrDict *ad, char *val, Count len)
+{
+	if (ad->nslots == 0) return NO_PAGE;
+	for (Count i = valueSlot(ad, val, len); ad->table[i] != 0; i = (i+1) & (ad->nslots-1)) {
+		Count code = ad->table[i] - 1;
+		if (ad->lens[code] == len && memcmp(ad->vals[code], val, len) == 0)
+			return code;
+	}
+	return NO_PAGE;
+}
+
+// give a value the next code; the table is kept under half full
+
+static Count addValue(AttrDict *ad, char *val, Count len)
+{
+	if (ad->n == ad->max) {
+		ad->max = (ad->max == 0) ? 64 : 2*ad->max;
+		ad->vals = realloc(ad->vals, ad->max*sizeof(char *));
+		ad->lens = realloc(ad->lens, ad->max*sizeof(Count));
+		assert(ad->vals != NULL && ad->lens != NULL);
+	}
+	Count code = ad->n++;
+	ad->vals[code] = malloc(len+1);
+	assert(ad->vals[code] != NULL);
+	memcpy(ad->vals[code], val, len);
+	ad->vals[code][len] = '\0';
+	ad->lens[code] = len;
+	if (2*ad->n > ad->nslots) {
+		free(ad->table);
+		ad->nslots = (ad->nslots == 0) ? 128 : 2*ad->nslots;
+		ad->table = calloc(ad->nslots, sizeof(Count));
+		assert(ad->table != NULL);
+		for (Count c = 0; c < ad->n; c++) {
+			Count i = valueSlot(ad, ad->vals[c], ad->lens[c]);
+			while (ad->table[i] != 0) i = (i+1) & (ad->nslots-1);
+			ad->table[i] = c+1;
+		}
+	}
+	else {
+		Count i = valueSlot(ad, val, len);
+		while (ad->table[i] != 0) i = (i+1) & (ad->nslots-1);
+		ad->table[i] = code+1;
+	}
+	return code;
+}
+
+// open the dictionaries of a relation whose encoded attributes
+//   are those in attrs, reading back every value recorded so far
+
+Dict openDict(char *name, Bits attrs, char mode)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.dict",name);
+	Dict d = malloc(sizeof(struct DictRep));
+	assert(d != NULL);
+	d->file = fopen(fname, (mode == 'w') ? "r+" : "r");
+	if (d->file == NULL) fatal("Can't open dictionary file");
+	d->attrs = attrs;
+	memset(d->dicts, 0, sizeof(d->dicts));
+	pthread_mutex_init(&d->lock, NULL);
+
+	DictRec rec;
+	char val[MAXTUPLEN];
+	long good = 0;
+	while (fread(&rec, sizeof(DictRec), 1, d->file) == 1) {
+		if (rec.att >= MAXATTRS || !bitIsSet(attrs, rec.att) || rec.len >= MAXTUPLEN)
+			fatal("Dictionary file is damaged");
+		if (fread(val, 1, rec.len, d->file) != rec.len) break;
+		addValue(&d->dicts[rec.att], val, rec.len);
+		good = ftell(d->file);
+	}
+	// new values go after the last whole record
+	if (mode == 'w') {
+		fflush(d->file);
+		if (ftruncate(fileno(d->file), good) != 0) fatal("Can't truncate dictionary file");
+		fseek(d->file, good, SEEK_SET);
+	}
+	return d;
+}
+
+void closeDict(Dict d)
+{
+	fclose(d->file);
+	for (Count a = 0; a < MAXATTRS; a++) {
+		AttrDict *ad = &d->dicts[a];
+		for (Count c = 0; c < ad->n; c++) free(ad->vals[c]);
+		free(ad->vals); free(ad->lens); free(ad->table);
+	}
+	pthread_mutex_destroy(&d->lock);
+	free(d);
+}
+
+// make the values recorded so far durable
+
+void syncDict(Dict d)
+{
+	pthread_mutex_lock(&d->lock);
+	fflush(d->file);
+	if (fsync(fileno(d->file)) != 0) fatal("Can't sync dictionary file");
+	pthread_mutex_unlock(&d->lock);
+}
+
+// number of values in the dictionary of attribute att
+
+Count dictSize(Dict d, Count att)
+{
+	pthread_mutex_lock(&d->lock);
+	Count n = d->dicts[att].n;
+	pthread_mutex_unlock(&d->lock);
+	return n;
+}
+
+// write a code at out; returns its length
+
+static Count putCode(Count code, char *out)
+{
+	char rev[MAXCODELEN];
+	Count n = 0;
+	rev[n++] = 0x80 | (code & 0x3F);
+	for (code >>= 6; code != 0; code >>= 6)
+		rev[n++] = 0xC0 | (code & 0x3F);
+	for (Count i = 0; i < n; i++) out[i] = rev[n-1-i];
+	return n;
+}
+
+// read the code of len bytes at in
+
+static Count getCode(char *in, Count len)
+{
+	Count code = 0;
+	for (Count i = 0; i < len; i++) code = (code << 6) | (in[i] & 0x3F);
+	return code;
+}
+
+// encode the values of the encoded attributes of tuple t
+// with add, values not seen before are given new codes; otherwise
+//   (for queries) a "?" is left as it is, and a value that has no
+//   code means no tuple can match, so NULL is returned
+// returns a new tuple, which the caller frees
+
+Tuple encodeTuple(Dict d, Tuple t, Bool add)
+{
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	Tuple e = malloc(n*(MAXCODELEN+1) + strlen(t) + 1);
+	assert(e != NULL);
+	char *c = e;
+	pthread_mutex_lock(&d->lock);
+	for (Count i = 0; i < n; i++) {
+		char *val = t + v[i].off;
+		Count len = v[i].len;
+		if (i > 0) *c++ = ',';
+		Bool plain = i >= MAXATTRS || !bitIsSet(d->attrs, i) ||
+		             (!add && len == 1 && val[0] == '?');
+		if (plain) {
+			memcpy(c, val, len);
+			c += len;
+			continue;
+		}
+		AttrDict *ad = &d->dicts[i];
+		Count code = findValue(ad, val, len);
+		if (code == NO_PAGE) {
+			if (!add) {
+				pthread_mutex_unlock(&d->lock);
+				free(e);
+				return NULL;
+			}
+			code = addValue(ad, val, len);
+			DictRec rec = { i, len };
+			if (fwrite(&rec, sizeof(DictRec), 1, d->file) != 1 ||
+			    fwrite(val, 1, len, d->file) != len || fflush(d->file) != 0)
+				fatal("Can't write dictionary file");
+		}
+		c += putCode(code, c);
+	}
+	pthread_mutex_unlock(&d->lock);
+	*c = '\0';
+	return e;
+}
+
+// put the plain version of encoded tuple t in buf (of MAXSTOREDLEN)
+
+void decodeTuple(Dict d, Tuple t, char *buf)
+{
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	char *c = buf;
+	pthread_mutex_lock(&d->lock);
+	for (Count i = 0; i < n; i++) {
+		char *val = t + v[i].off;
+		Count len = v[i].len;
+		if (i > 0) *c++ = ',';
+		if (i < MAXATTRS && bitIsSet(d->attrs, i)) {
+			Count code = getCode(val, len);
+			if (code >= d->dicts[i].n) fatal("Tuple has a code not in the dictionary");
+			val = d->dicts[i].vals[code];
+			len = d->dicts[i].lens[code];
+		}
+		assert(c + len < buf + MAXSTOREDLEN);
+		memcpy(c, val, len);
+		c += len;
+	}
+	pthread_mutex_unlock(&d->lock);
+	*c = '\0';
+}
@@ -0,0 +1,22 @@
+// dict.h ... interface to a relation's value dictionaries
+// part of Multi-attribute Linear-hashed Files
+// See dict.c for details of Dict type and functions
+
+#ifndef DICT_H
+#define DICT_H 1
+
+typedef struct DictRep *Dict;
+
+#include "defs.h"
+#include "bits.h"
+#include "tuple.h"
+
+Status newDict(char *name);
+Dict openDict(char *name, Bits attrs, char mode);
+void closeDict(Dict d);
+void syncDict(Dict d);
+Count dictSize(Dict d, Count att);
+Tuple encodeTuple(Dict d, Tuple t, Bool add);
+void decodeTuple(Dict d, Tuple t, char *buf);
+
+#endif
@@ -6,9 +6,8 @@
 
 #include "defs.h"
 #include "reln.h"
-#include "page.h"
-
-void showAllTuples(Page);
+#include "scan.h"
+#include "tuple.h"
 
 #define USAGE "./dump  RelName"
 
@@ -29,36 +28,33 @@ int main(int argc, char **argv)
 	if (r == NULL)
 		fatal("Can't open relation");
 
+	Bool plain = dictionary(r) == NULL && intAttrs(r) == 0;
+	char raw[MAXSTOREDLEN], tup[MAXTUPLEN];
+	Scan s = startScan(r, 0);
 	for (Offset pid = 0; pid < npages(r); pid++) {
 		printf("Bucket[%d]\n",pid);
-		// show tuples in data file
-		Page pg = getPage(dataFile(r),pid);
-		showAllTuples(pg);
-		// show tuples in overflow pages
-		Page ovpg;  PageID ovp;
-		ovp = pageOvflow(pg);
-		while (ovp != NO_PAGE) {
-			printf("Ovflow->\n");
-			ovpg = getPage(ovflowFile(r), ovp);
-			showAllTuples(ovpg);
-			ovp = pageOvflow(ovpg);
-			free(ovpg);
+		// show tuples in data page, then in overflow pages
+		resetScan(s, pid);
+		while (nextScanPage(s)) {
+			if (scanInOvflow(s)) printf("Ovflow->\n");
+			Tuple t;
+			while ((t = nextScanTuple(s)) != NULL) {
+				Count len = scanTupleLength(s);
+				if (plain)
+					fwrite(t, 1, len, stdout);
+				else {
+					// stored values are shown as they were inserted
+					memcpy(raw, t, len);
+					raw[len] = '\0';
+					showTuple(r, raw, tup);
+					fputs(tup, stdout);
+				}
+				putchar('\n');
+			}
 		}
-		free(pg);
 	}
+	closeScan(s);
 	closeRelation(r);
 
 	return 0;
 }
-
-// scan all tuples in Page
-
-void showAllTuples(Page pg)
-{
-		Count ntups = pageNTuples(pg);
-		char *c = pageData(pg);
-		for (int i = 0; i < ntups; i++) {
-			printf("%s\n", c);
-			c += strlen(c) + 1;
-		}
-}
@@ -7,14 +7,15 @@
 #include "defs.h"
 
 #define USAGE "./insert  #tuples  #attributes  [startID]  [seed]"
+#define MAXGENTUPS 1000000000  // most tuples generated in one go
 
 // Main ... process args, read/insert tuples
 
 int main(int argc, char **argv)
 {
 	int  natts;    // number of attributes in each tuple
-	int  ntups;    // number of tuples
-	int  startID;  // starting ID
+	long ntups;    // number of tuples
+	long startID;  // starting ID
 	char err[MAXERRMSG]; // buffer for error messages
 
 	// process command-line args
@@ -22,16 +23,16 @@ int main(int argc, char **argv)
 	if (argc < 3) fatal(USAGE);
 
 	// how many tuples
-	ntups = atoi(argv[1]);
-	if (ntups < 1 || ntups > 100000) {
-		sprintf(err, "Invalid #tuples: %d (must be 0 < # < 10^6)", ntups);
+	ntups = atol(argv[1]);
+	if (ntups < 1 || ntups > MAXGENTUPS) {
+		sprintf(err, "Invalid #tuples: %ld (must be 0 < # <= %d)", ntups, MAXGENTUPS);
 		fatal(err);
 	}
 
 	// how many attributes in each tuple
 	natts = atoi(argv[2]);
-	if (natts < 2 || natts > 10) {
-		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 11)", natts);
+	if (natts < 2 || natts > MAXATTRS) {
+		sprintf(err, "Invalid #attrs: %d (must be 1 < # <= %d)", natts, MAXATTRS);
 		fatal(err);
 	}
 
@@ -39,7 +40,7 @@ int main(int argc, char **argv)
 	if (argc < 4)
 		startID = 1;
 	else
-		startID = atoi(argv[3]);
+		startID = atol(argv[3]);
 
 	// seed random # generator
 	if (argc < 5)
@@ -49,12 +50,13 @@ int main(int argc, char **argv)
 
 	// reflects distribution of letter usage in english ... somewhat
 	// id ensures that all tuples are distinct
-	int i, j, id=startID;
+	long i, id=startID;
+	int j;
 	char attr[MAXTUPLEN];
 	char tuple[MAXTUPLEN];
 	char *randWord();
 	for (i = 0; i < ntups; i++) {
-		sprintf(tuple,"%d",id++);
+		sprintf(tuple,"%ld",id++);
 		for (j = 0; j < natts-1; j++) {
 			sprintf(attr,",%s",randWord());
 			strcat(tuple,attr);
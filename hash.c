@@ -95,3 +95,16 @@ hash_any(unsigned char *k, int keylen)
 	final(a, b, c);
 	return c;
 }
+
+// hash a single 32-bit value, as for integer attributes
+// (PostgreSQL's hash_uint32: hash_any of the 4 bytes, in one step)
+
+Bits
+hash_uint32(Bits k)
+{
+	Bits a, b, c;
+	a = b = c = 0x9e3779b9 + (Bits) sizeof(Bits) + 3923095;
+	a += k;
+	final(a, b, c);
+	return c;
+}
@@ -9,5 +9,6 @@
 #include "bits.h"
 
 Bits hash_any(unsigned char *, int);
+Bits hash_uint32(Bits);
 
 #endif
@@ -0,0 +1,84 @@
+// hashbench.c ... compare ways of combining attribute hashes
+// part of Multi-attribute linear-hashed files
+// Times the reference, table-driven and PEXT/PDEP versions
+//   of the choice-vector hash on a relation's choice vector,
+//   and checks that all three give identical results (PEXT/PDEP
+//   only where the CPU has BMI2)
+// Usage:  ./hashbench  RelName  [#iterations]
+
+#include <time.h>
+#include "defs.h"
+#include "reln.h"
+#include "chvec.h"
+
+#define USAGE "./hashbench  RelName  [#iterations]"
+#define NSAMPLES 4096
+
+static double elapsed(clock_t start)
+{
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// Main ... process args, run each method over the same samples
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) fatal(USAGE);
+	char *rname = argv[1];
+	long niters = (argc < 3) ? 10000000 : atol(argv[2]);
+	if (niters < NSAMPLES) niters = NSAMPLES;
+
+	if (!existsRelation(rname)) fatal("No such relation");
+	Reln r = openRelation(rname, "r");
+	if (r == NULL) fatal("Can't open relation");
+	Count na = nattrs(r);
+	ChVecItem *cv = chvec(r);
+	ChVecPlan plan = chvecPlan(r);
+
+	// random per-attribute hashes
+	Bits *samples = malloc(NSAMPLES*na*sizeof(Bits));
+	assert(samples != NULL);
+	srand(0);
+	for (long i = 0; i < NSAMPLES*na; i++)
+		samples[i] = ((Bits)rand() << 16) ^ (Bits)rand();
+
+	// all methods must agree bit for bit
+	// (PEXT can only be run on CPUs that have BMI2)
+	Bool pext = havePext();
+	for (long i = 0; i < NSAMPLES; i++) {
+		Bits *h = &samples[i*na];
+		Bits ref = chvecHashRef(cv, h);
+		if (chvecHashTable(plan, h) != ref) fatal("table hash differs");
+		if (pext && chvecHashPext(plan, h) != ref) fatal("pext hash differs");
+	}
+
+	Bits sum; clock_t start; double t;
+	printf("%ld hashes, %d attributes, BMI2 %savailable\n",
+	       niters, na, pext ? "" : "not ");
+
+	sum = 0; start = clock();
+	for (long i = 0; i < niters; i++)
+		sum ^= chvecHashRef(cv, &samples[(i%NSAMPLES)*na]);
+	t = elapsed(start);
+	printf("%-10s %8.2f ns/hash  (%08x)\n", "reference", t*1e9/niters, sum);
+
+	sum = 0; start = clock();
+	for (long i = 0; i < niters; i++)
+		sum ^= chvecHashTable(plan, &samples[(i%NSAMPLES)*na]);
+	t = elapsed(start);
+	printf("%-10s %8.2f ns/hash  (%08x)\n", "table", t*1e9/niters, sum);
+
+	if (!pext)
+		printf("%-10s skipped (no BMI2)\n", "pext");
+	else {
+		sum = 0; start = clock();
+		for (long i = 0; i < niters; i++)
+			sum ^= chvecHashPext(plan, &samples[(i%NSAMPLES)*na]);
+		t = elapsed(start);
+		printf("%-10s %8.2f ns/hash  (%08x)\n", "pext", t*1e9/niters, sum);
+	}
+
+	free(samples);
+	closeRelation(r);
+	return 0;
+}
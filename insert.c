@@ -1,14 +1,21 @@
 // insert.c ... add tuples to a relation
 // part of Multi-attribute linear-hashed files
 // Reads tuples from stdin and inserts into Reln
-// Usage:  ./insert  [-v]  RelName
+// Usage:  ./insert  [-v]  [-b | [-B]  [-w ms]  [-n BatchSize]]  RelName
+// -b bulk-loads all of stdin into an empty relation; a bulk load
+//    is not logged and does its own splits, so -b can't be used
+//    with -B, -w or -n
+// -B leaves bucket splits to a background thread
+// -w logs inserts, committing them every ms milliseconds
+// -n inserts tuples in batches of BatchSize
 // Last modified by John Shepherd, July 2019
 
 #include "defs.h"
 #include "reln.h"
 #include "tuple.h"
 
-#define USAGE "./insert  [-v]  RelName"
+#define USAGE "./insert  [-v]  [-b | [-B]  [-w ms]  [-n BatchSize]]  RelName"
+#define MAXBULK 0xffffffffULL  // most tuples in a bulk load (a Count)
 
 // Main ... process args, read/insert tuples
 
@@ -16,18 +23,39 @@ int main(int argc, char **argv)
 {
 	Reln r;  // handle on the open relation
 	Tuple t;  // tuple buffer
-	char err[2*MAXERRMSG];  // buffer for error messages
+	char err[MAXERRMSG+MAXTUPLEN];  // buffer for error messages
 	char tup[MAXTUPLEN];  // buffer for printable tuples
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
+	int bulk = 0;  // load all tuples in one pass
+	int bgsplit = 0;  // split buckets in the background
+	int interval = -1;  // ms between commits (-1 if not logged)
+	int batch = 0;  // #tuples per addManyToRelation() call
 	char *rname;  // name of table/file
 
 	// process command-line args
 
-	if (argc < 2) fatal(USAGE);
-    if (strcmp(argv[1], "-v") == 0)
-		{ verbose = 1; rname = argv[2]; }
-	else
-		{ verbose = 0; rname = argv[1]; }
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[a], "-b") == 0)
+			bulk = 1;
+		else if (strcmp(argv[a], "-B") == 0)
+			bgsplit = 1;
+		else if (strcmp(argv[a], "-w") == 0 && a+1 < argc) {
+			interval = atoi(argv[++a]);
+			if (interval < 0) fatal(USAGE);
+		}
+		else if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+			batch = atoi(argv[++a]);
+			if (batch < 1) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
+	}
+	if (a >= argc) fatal(USAGE);
+	if (bulk && (bgsplit || interval >= 0 || batch > 0)) fatal(USAGE);
+	rname = argv[a];
 
 
 	// set up relation for writing
@@ -37,13 +65,57 @@ int main(int argc, char **argv)
 		fatal(err);
 	}
 	if ((r = openRelation(rname,"r+")) == NULL) {
-		sprintf(err, "Can't open relation: %s",argv[1]);
+		sprintf(err, "Can't open relation: %s",rname);
 		fatal(err);
 	}
 
 	// read stdin and insert tuples
 
-	while ((t = readTuple(r,stdin)) != NULL) {
+	if (interval >= 0) logRelation(r, interval);
+	if (bgsplit) backgroundSplits(r, TRUE);
+	if (bulk) {
+		// buffer the whole input, then load in one pass
+		BigCount n = 0, max = 1024;
+		Tuple *tuples = malloc(max*sizeof(Tuple));
+		assert(tuples != NULL);
+		while ((t = readTuple(r,stdin)) != NULL) {
+			if (n == MAXBULK) {
+				sprintf(err, "Too many tuples for a bulk load (at most %llu)", MAXBULK);
+				fatal(err);
+			}
+			if (n == max) {
+				max *= 2;
+				tuples = realloc(tuples, max*sizeof(Tuple));
+				assert(tuples != NULL);
+			}
+			tuples[n++] = t;
+		}
+		if (bulkLoadRelation(r, tuples, n) != OK) {
+			sprintf(err, "Bulk load into %s failed (relation must be empty and each tuple must fit in a page)", rname);
+			fatal(err);
+		}
+		if (verbose) printf("Loaded %llu tuples\n", n);
+		for (BigCount i = 0; i < n; i++) free(tuples[i]);
+		free(tuples);
+	}
+	else if (batch > 0) {
+		// group tuples so each bucket is visited once per batch
+		Tuple *tuples = malloc(batch*sizeof(Tuple));
+		assert(tuples != NULL);
+		Count n;
+		do {
+			for (n = 0; n < batch; n++)
+				if ((tuples[n] = readTuple(r,stdin)) == NULL) break;
+			if (addManyToRelation(r, tuples, n) != OK) {
+				sprintf(err, "Insert of batch into %s failed", rname);
+				fatal(err);
+			}
+			if (verbose) printf("Inserted batch of %d tuples\n", n);
+			for (Count i = 0; i < n; i++) free(tuples[i]);
+		} while (n == batch);
+		free(tuples);
+	}
+	else while ((t = readTuple(r,stdin)) != NULL) {
 		PageID pid;
 		pid = addToRelation(r,t);
 
@@ -56,10 +128,15 @@ int main(int argc, char **argv)
 		free(t);
 	}
 
+	if (verbose) {
+		BufPool pool = bufPool(r);
+		printf("Buffer pool: %d frames  hits:%d  misses:%d  mapped:%d\n",
+		       poolSize(pool), poolHits(pool), poolMisses(pool), poolMapped(pool));
+	}
+
 	// clean up
 
 	closeRelation(r);
 
 	return 0;
 }
-
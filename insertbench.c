@@ -0,0 +1,124 @@
+// insertbench.c ... time single-tuple inserts into a relation
+// part of Multi-attribute linear-hashed files
+// Reads tuples from stdin, inserts them one at a time, and
+//   reports the spread of insert times and the overall rate
+// Usage:  ./insertbench  [-B]  [-t #threads]  [-w ms]  RelName
+// -B leaves bucket splits to a background thread
+// -t shares the tuples out between several inserting threads
+// -w logs the inserts, committing them every ms milliseconds
+//   (the time to close, and so checkpoint, the relation is shown)
+
+#include <pthread.h>
+#include "defs.h"
+#include "reln.h"
+#include "tuple.h"
+
+#define USAGE "./insertbench  [-B]  [-t #threads]  [-w ms]  RelName"
+#define MAXTHREADS 64
+
+static int cmpDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+// each thread inserts every nthreads'th tuple, from tuple first
+
+typedef struct {
+	Reln    r;
+	Tuple  *tuples;
+	double *lat;
+	Count   n, first, nthreads;
+} Work;
+
+static void *inserter(void *arg)
+{
+	Work *w = arg;
+	for (Count i = w->first; i < w->n; i += w->nthreads) {
+		double t0 = now();
+		if (addToRelation(w->r, w->tuples[i]) == NO_PAGE) fatal("Insert failed");
+		w->lat[i] = now() - t0;
+	}
+	return NULL;
+}
+
+// Main ... process args, time the inserts
+
+int main(int argc, char **argv)
+{
+	int bgsplit = 0;
+	Count nthreads = 1;
+	int interval = -1;
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-B") == 0)
+			bgsplit = 1;
+		else if (strcmp(argv[a], "-w") == 0 && a+1 < argc) {
+			interval = atoi(argv[++a]);
+			if (interval < 0) fatal(USAGE);
+		}
+		else if (strcmp(argv[a], "-t") == 0 && a+1 < argc) {
+			nthreads = atoi(argv[++a]);
+			if (nthreads < 1 || nthreads > MAXTHREADS) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
+	}
+	if (a != argc-1) fatal(USAGE);
+	char *rname = argv[a];
+
+	if (!existsRelation(rname)) fatal("No such relation");
+	Reln r = openRelation(rname, "r+");
+	if (r == NULL) fatal("Can't open relation");
+
+	// read all tuples first, so only the inserts are timed
+	Count n = 0, max = 1024;
+	Tuple t, *tuples = malloc(max*sizeof(Tuple));
+	assert(tuples != NULL);
+	while ((t = readTuple(r,stdin)) != NULL) {
+		if (n == max) {
+			max *= 2;
+			tuples = realloc(tuples, max*sizeof(Tuple));
+			assert(tuples != NULL);
+		}
+		tuples[n++] = t;
+	}
+	if (n == 0) fatal("No tuples to insert");
+	double *lat = malloc(n*sizeof(double));
+	assert(lat != NULL);
+
+	if (interval >= 0) logRelation(r, interval);
+	if (bgsplit) backgroundSplits(r, TRUE);
+	Work work[MAXTHREADS];
+	pthread_t threads[MAXTHREADS];
+	double start = now();
+	for (Count i = 0; i < nthreads; i++) {
+		work[i] = (Work){ r, tuples, lat, n, i, nthreads };
+		if (pthread_create(&threads[i], NULL, inserter, &work[i]) != 0)
+			fatal("Can't start inserter thread");
+	}
+	for (Count i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+	double inserted = now();
+	Count owed = bgsplit ? splitsOwed(r) : 0;
+	backgroundSplits(r, FALSE);
+	double finish = now();
+
+	qsort(lat, n, sizeof(double), cmpDouble);
+	printf("%d inserts by %d thread%s, splits in %s, ", n, nthreads,
+	       (nthreads == 1) ? "" : "s", bgsplit ? "background" : "foreground");
+	if (interval < 0)
+		printf("not logged\n");
+	else
+		printf("commit every %d ms\n", interval);
+	printf("latency us: p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+	       lat[n/2]*1e6, lat[n*99/100]*1e6, lat[n*999/1000]*1e6, lat[n-1]*1e6);
+	printf("inserts: %.0f/sec  (%.0f/sec including %d splits owed at end)\n",
+	       n/(inserted-start), n/(finish-start), owed);
+
+	for (Count i = 0; i < n; i++) free(tuples[i]);
+	free(tuples); free(lat);
+	start = now();
+	closeRelation(r);
+	if (interval >= 0) printf("close: %.3f sec\n", now() - start);
+	return 0;
+}
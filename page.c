@@ -3,8 +3,11 @@
 // Reading/writing pages into buffers and manipulating contents
 // Last modified by John Shepherd, July 2019
 
+#include <unistd.h>
+#include <sys/stat.h>
 #include "defs.h"
 #include "page.h"
+#include "hash.h"
 
 // internal representation of pages
 struct PageRep {
@@ -14,91 +17,324 @@ struct PageRep {
 	char data[1];  // start of data
 };
 
-// A Page is a chunk of memory containing PAGESIZE bytes
+// A Page is a chunk of memory containing size bytes, where size
+//   is the page size of its relation (a power of two, from
+//   MINPAGESIZE to MAXPAGESIZE, recorded in rel.info)
+// - pages don't record their own size, so every function that
+//   needs to find the end of a page is told the size
 // It is implemented as a struct (free, ovflow, data[1])
 // - free is the offset of the first byte of free space
 // - ovflow is the page id of the next overflow page in bucket
 // - data[] is a sequence of bytes containing tuples
 // - each tuple is a sequence of chars terminated by '\0'
 // - PageID values count # pages from start of file
+// Slotted pages (SLOTTED_PAGES format) also have a directory of
+//   slots growing down from the end of the page, one per tuple
+// - slot i holds the offset, length and flags of tuple i
+// - tuples are still stored in slot order from the start of data[],
+//   so the same page can be read either way
+// Signed pages (SIGNED_PAGES format) are slotted pages that end
+//   with a signature: a small Bloom filter over the attribute
+//   values of the tuples in the page
+// - each value sets SIGPROBES bits, chosen by hashing the value
+//   together with its attribute number
+// - a page can only hold a tuple with some attribute value if all
+//   of that value's bits are set, so queries can pass over pages
+//   whose signature lacks the bits of the query's known values
+// - the slot directory grows down from just before the signature
+// Hashed pages (HASHED_PAGES format) are signed pages whose slots
+//   also hold the composite (choice vector) hash of each tuple,
+//   so it never needs to be worked out again from the tuple
+// An empty page is the same in all formats
+
+typedef struct {
+	unsigned short off;   // offset of tuple within data[]
+	unsigned short len;   // tuple length, without the '\0'
+	unsigned short flags; // none yet; always 0
+} Slot;
+
+// slots in hashed pages; kept as shorts so that slots need
+//   no more than 2-byte alignment in either layout
+typedef struct {
+	Slot  slot;
+	unsigned short hashlo, hashhi; // composite hash of tuple
+} HashedSlot;
+
+#define HDRSIZE (2*sizeof(Offset) + sizeof(Count))
+
+#define SIGPROBES 2  // bits set in a signature for each value
+
+// bytes at the end of a page holding its signature
+// signatures grow with the page, so that bigger pages, holding
+//   more values, don't have more bits set than smaller ones
+static Count sigSize(PageFormat fmt, Count size)
+{
+	return (fmt >= SIGNED_PAGES) ? SIGWORDS(size)*sizeof(Bits) : 0;
+}
+
+// bytes in each slot
+static Count slotSize(PageFormat fmt)
+{
+	return (fmt >= HASHED_PAGES) ? sizeof(HashedSlot) : sizeof(Slot);
+}
+
+// slot i is stored i+1 slots back from the end of the page
+static Slot *slot(Page p, PageFormat fmt, Count size, Count i)
+{
+	char *end = (char *)p + size - sigSize(fmt, size);
+	return (Slot *)(end - (i+1)*slotSize(fmt));
+}
+
+// the signature of a signed page
+static Bits *signature(Page p, Count size)
+{
+	return (Bits *)((char *)p + size) - SIGWORDS(size);
+}
+
+// is size a page size that relations may have?
+Bool validPageSize(Count size)
+{
+	return size >= MINPAGESIZE && size <= MAXPAGESIZE && (size & (size-1)) == 0;
+}
 
 // create a new initially empty page in memory
-Page newPage()
+Page newPage(Count size)
 {
-	Page p = malloc(PAGESIZE);
+	Page p = malloc(size);
 	assert(p != NULL);
+	initPage(p, size);
+	return p;
+}
+
+// reset a page buffer to the empty state
+void initPage(Page p, Count size)
+{
 	p->free = 0;
 	p->ovflow = NO_PAGE;
 	p->ntuples = 0;
-	Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
-	int dataSize = PAGESIZE - hdr_size;
-	memset(p->data, 0, dataSize);
-	return p;
+	memset(p->data, 0, size - HDRSIZE);
 }
 
-// append a new Page to a file; return its PageID
-PageID addPage(FILE *f)
+// file offsets are 64 bits (the Makefile asks for them where they
+//   aren't already), so a file can hold any PageID's worth of pages
+typedef char offsetsAre64Bits[sizeof(off_t) >= 8 ? 1 : -1];
+
+// where page pid starts in a file of pages of the given size
+
+off_t pageOffset(PageID pid, Count size)
+{
+	return (off_t)pid*size;
+}
+
+// number of whole pages in a file
+
+Count filePages(FILE *f, Count size)
 {
-	int ok = fseek(f, 0, SEEK_END);
+	struct stat st;
+	int ok = fstat(fileno(f), &st);
 	assert(ok == 0);
-	int pos = ftell(f);
-	assert(pos >= 0);
-	PageID pid = pos/PAGESIZE;
-	Page p = newPage();
-	ok = putPage(f, pid, p);
+	return st.st_size / size;
+}
+
+// append a new Page to a file; return its PageID
+// callers that share a file must not add pages at the same time
+
+PageID addPage(FILE *f, Count size)
+{
+	PageID pid = filePages(f, size);
+	Page p = newPage(size);
+	int ok = putPage(f, pid, p, size);
 	assert(ok == 0);
 	return pid;
 }
 
 // fetch a Page from a file; allocate a memory buffer
-Page getPage(FILE *f, PageID pid)
+Page getPage(FILE *f, PageID pid, Count size)
 {
-	assert(pid >= 0);
-	Page p = malloc(PAGESIZE);
+	Page p = malloc(size);
 	assert(p != NULL);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fread(p, 1, PAGESIZE, f);
-	assert(n == PAGESIZE);
+	readPage(f, pid, p, size);
 	return p;
 }
 
 // write a Page to a file; release allocated buffer
-Status putPage(FILE *f, PageID pid, Page p)
+Status putPage(FILE *f, PageID pid, Page p, Count size)
 {
-	assert(pid >= 0);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fwrite(p, 1, PAGESIZE, f);
-	assert(n == PAGESIZE);
+	writePage(f, pid, p, size);
 	free(p);
 	return 0;
 }
 
-// insert a tuple into a page
+// page I/O is positional (no shared file offset), so that
+//   threads can read and write pages of the same file at once;
+//   the FILE's own buffer is never used for pages
+
+// read a Page from a file into a caller-supplied buffer
+void readPage(FILE *f, PageID pid, Page p, Count size)
+{
+	assert(pid >= 0);
+	ssize_t n = pread(fileno(f), p, size, pageOffset(pid, size));
+	assert(n == size);
+}
+
+// write a Page buffer to a file; buffer remains owned by caller
+void writePage(FILE *f, PageID pid, Page p, Count size)
+{
+	assert(pid >= 0);
+	ssize_t n = pwrite(fileno(f), p, size, pageOffset(pid, size));
+	assert(n == size);
+}
+
+// add the bits for value hash h of attribute att to a signature
+//   for pages of the given size
+
+void addToSignature(Bits *sig, Count att, Bits h, Count size)
+{
+	Count nbits = SIGWORDS(size)*MAXBITS;
+	// spread the hash, so that equal values in different
+	//   attributes set different bits
+	Bits g = (h ^ (att+1)*0x9e3779b9) * 0x85ebca6b;
+	for (int k = 0; k < SIGPROBES; k++) {
+		Bits b = (g >> (k*11)) % nbits;
+		sig[b/MAXBITS] |= 1u << (b%MAXBITS);
+	}
+}
+
+// add the values of a tuple to a signature
+static void signTuple(Bits *sig, Tuple t, Count size)
+{
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	for (Count i = 0; i < n; i++)
+		addToSignature(sig, i, hash_any((unsigned char *)t + v[i].off, v[i].len), size);
+}
+
+// might the page hold tuples having all of the values in sig?
+// pages without a signature might hold anything
+
+Bool pageMayMatch(Page p, PageFormat fmt, Bits *sig, Count size)
+{
+	if (fmt < SIGNED_PAGES) return TRUE;
+	Bits *ps = signature(p, size);
+	for (Count i = 0; i < SIGWORDS(size); i++)
+		if ((ps[i] & sig[i]) != sig[i]) return FALSE;
+	return TRUE;
+}
+
+// insert a tuple, whose composite hash is h, into a page
 // returns 0 status if successful
 // returns -1 if not enough room
-Status addToPage(Page p, Tuple t)
+Status addToPage(Page p, Tuple t, Bits h, PageFormat fmt, Count size)
 {
 	int n = tupLength(t);
 	char *c = p->data + p->free;
-	Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
 	// doesn't fit ... return fail code
 	// assume caller will put it elsewhere
-	if (c+n > &p->data[PAGESIZE-hdr_size-2]) return -1;
+	if (fmt >= SLOTTED_PAGES) {
+		if (n+1 > pageFreeSpace(p, fmt, size)) return -1;
+		Slot *s = slot(p, fmt, size, p->ntuples);
+		s->off = p->free;
+		s->len = n;
+		s->flags = 0;
+		if (fmt >= HASHED_PAGES) {
+			HashedSlot *hs = (HashedSlot *)s;
+			hs->hashlo = h & 0xffff;
+			hs->hashhi = h >> 16;
+		}
+	}
+	else if (c+n > &p->data[size-HDRSIZE-2]) return -1;
 	strcpy(c, t);
 	p->free += n+1;
 	p->ntuples++;
+	if (fmt >= SIGNED_PAGES) signTuple(signature(p, size), t, size);
 	return OK;
 }
 
+// operations on slotted pages
+
+// tuple in slot i
+Tuple pageTuple(Page p, Count i, PageFormat fmt, Count size)
+{
+	assert(i < p->ntuples);
+	return p->data + slot(p, fmt, size, i)->off;
+}
+
+// length of tuple in slot i
+Count pageTupleLength(Page p, Count i, PageFormat fmt, Count size)
+{
+	assert(i < p->ntuples);
+	return slot(p, fmt, size, i)->len;
+}
+
+// composite hash of the tuple in slot i (hashed pages only)
+Bits pageTupleHash(Page p, Count i, PageFormat fmt, Count size)
+{
+	assert(i < p->ntuples && fmt >= HASHED_PAGES);
+	HashedSlot *hs = (HashedSlot *)slot(p, fmt, size, i);
+	return hs->hashlo | (Bits)hs->hashhi << 16;
+}
+
 // extract page info
 char *pageData(Page p) { return p->data; }
+Offset pageUsed(Page p) { return p->free; }
 Count pageNTuples(Page p) { return p->ntuples; }
 Offset pageOvflow(Page p) { return p->ovflow; }
 void pageSetOvflow(Page p, PageID pid) { p->ovflow = pid; }
-Count pageFreeSpace(Page p) {
-	Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
-	return (PAGESIZE-hdr_size-p->free);
+// bytes of a page available for tuples (and their slots)
+Count pageCapacity(PageFormat fmt, Count size)
+{
+	return size - HDRSIZE - sigSize(fmt, size);
+}
+
+// bytes a format spends on each tuple, beyond the tuple itself
+Count slotSpace(PageFormat fmt)
+{
+	return (fmt >= SLOTTED_PAGES) ? slotSize(fmt) : 0;
+}
+
+// page formats by name; 0 if there is no such format
+static char *formatNames[] = { NULL, "packed", "slotted", "signed", "hashed" };
+
+PageFormat parseFormat(char *name)
+{
+	for (PageFormat f = PACKED_PAGES; f <= HASHED_PAGES; f++)
+		if (strcmp(name, formatNames[f]) == 0) return f;
+	return 0;
 }
 
+char *formatName(PageFormat fmt)
+{
+	return (fmt >= PACKED_PAGES && fmt <= HASHED_PAGES) ? formatNames[fmt] : "unknown";
+}
+
+// bytes a tuple takes up in a page, counting its slot
+Count tupleSpace(Tuple t, PageFormat fmt)
+{
+	Count n = tupLength(t) + 1;
+	return (fmt >= SLOTTED_PAGES) ? n + slotSize(fmt) : n;
+}
+
+// would a tuple fit in an empty page? (see addToPage)
+Bool fitsInPage(Tuple t, PageFormat fmt, Count size)
+{
+	Count n = tupLength(t);
+	if (fmt >= SLOTTED_PAGES)
+		return n+1 + HDRSIZE + slotSize(fmt) + sigSize(fmt, size) <= size;
+	return n + HDRSIZE + 2 <= size;
+}
+
+// bytes of a page taken up by its tuples
+Count pageSpaceUsed(Page p, PageFormat fmt)
+{
+	Count n = p->free;
+	return (fmt >= SLOTTED_PAGES) ? n + p->ntuples*slotSize(fmt) : n;
+}
+
+// free bytes in a page; slotted pages keep back room for one more slot
+Count pageFreeSpace(Page p, PageFormat fmt, Count size) {
+	Count used = HDRSIZE + p->free;
+	if (fmt >= SLOTTED_PAGES) used += (p->ntuples+1)*slotSize(fmt);
+	used += sigSize(fmt, size);
+	return (used > size) ? 0 : size-used;
+}
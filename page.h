@@ -8,18 +8,50 @@
 
 typedef struct PageRep *Page;
 
+// page formats, as recorded in rel.info
+typedef Count PageFormat;
+#define PACKED_PAGES  1  // tuples back to back
+#define SLOTTED_PAGES 2  // tuples plus a slot directory
+#define SIGNED_PAGES  3  // slotted, plus a signature of the values
+#define HASHED_PAGES  4  // signed, with tuple hashes in the slots
+
+// Bits in the signature of a page of size bytes
+#define SIGWORDS(size) ((size)/64)
+#define MAXSIGWORDS SIGWORDS(MAXPAGESIZE)
+
+#include <sys/types.h>
 #include "defs.h"
 #include "tuple.h"
+#include "bits.h"
 
-Page newPage();
-PageID addPage(FILE *);
-Page getPage(FILE *, PageID);
-Status putPage(FILE *, PageID, Page);
-Status addToPage(Page, Tuple);
+Page newPage(Count);
+void initPage(Page, Count);
+PageID addPage(FILE *, Count);
+Count filePages(FILE *, Count);
+off_t pageOffset(PageID, Count);
+Page getPage(FILE *, PageID, Count);
+Status putPage(FILE *, PageID, Page, Count);
+void readPage(FILE *, PageID, Page, Count);
+void writePage(FILE *, PageID, Page, Count);
+Bool validPageSize(Count);
+Status addToPage(Page, Tuple, Bits, PageFormat, Count);
 char *pageData(Page);
+Offset pageUsed(Page);
 Count pageNTuples(Page);
 Offset pageOvflow(Page);
 void pageSetOvflow(Page, PageID);
-Count pageFreeSpace(Page);
+Count pageFreeSpace(Page, PageFormat, Count);
+Count pageCapacity(PageFormat, Count);
+Count tupleSpace(Tuple, PageFormat);
+Bool fitsInPage(Tuple, PageFormat, Count);
+Count slotSpace(PageFormat);
+PageFormat parseFormat(char *);
+char *formatName(PageFormat);
+Count pageSpaceUsed(Page, PageFormat);
+Tuple pageTuple(Page, Count, PageFormat, Count);
+Count pageTupleLength(Page, Count, PageFormat, Count);
+Bits pageTupleHash(Page, Count, PageFormat, Count);
+void addToSignature(Bits *, Count, Bits, Count);
+Bool pageMayMatch(Page, PageFormat, Bits *, Count);
 
 #endif
@@ -0,0 +1,142 @@
+// pagebench.c ... compare page sizes on the same tuples
+// part of Multi-attribute linear-hashed files
+// Reads tuples from stdin, then for each page size from 1K to 64K
+//   builds a relation from them, a tuple at a time, and runs the
+//   same queries on it, reporting insert and query rates
+// Usage:  ./pagebench  [-f packed|slotted|signed|hashed]  [-q #queries]  RelName  #attrs  ChoiceVector
+// RelName must not exist; it is created and removed for each size
+// Each query has one attribute known, taken from a random tuple
+
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "page.h"
+
+#define USAGE "./pagebench  [-f packed|slotted|signed|hashed]  [-q #queries]  RelName  #attrs  ChoiceVector"
+
+static void removeRelation(char *name)
+{
+	char *suffix[] = { "info", "data", "ovflow", "tails", "wal", "dict" };
+	char fname[MAXFILENAME];
+	for (int i = 0; i < 6; i++) {
+		sprintf(fname, "%s.%s", name, suffix[i]);
+		remove(fname);
+	}
+}
+
+// create the relation
+
+static void create(char *name, Count nattrs, char *cv, PageFormat format, Count size)
+{
+	Count param = defaultSplitParam(SPLIT_EVERY, nattrs, format, size);
+	Status ok = newRelation(name, nattrs, 1, 0, cv, format, size, SPLIT_EVERY, param, 0, 0);
+	if (ok != OK) fatal("Can't create relation");
+}
+
+// a query string with just attribute att of t known
+
+static void makeQuery(Tuple t, Count nattrs, Count att, char *q)
+{
+	char *val = t;
+	for (Count i = 0; i < att; i++) val = strchr(val, ',') + 1;
+	Count len = strcspn(val, ",");
+	q[0] = '\0';
+	for (Count i = 0; i < nattrs; i++) {
+		if (i > 0) strcat(q, ",");
+		if (i == att)
+			strncat(q, val, len);
+		else
+			strcat(q, "?");
+	}
+}
+
+// Main ... process args, build and query a relation for each size
+
+int main(int argc, char **argv)
+{
+	PageFormat format = PACKED_PAGES;
+	int nqueries = 1000;
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-f") == 0 && a+1 < argc) {
+			if ((format = parseFormat(argv[++a])) == 0) fatal(USAGE);
+		}
+		else if (strcmp(argv[a], "-q") == 0 && a+1 < argc) {
+			nqueries = atoi(argv[++a]);
+			if (nqueries < 1) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
+	}
+	if (a != argc-3) fatal(USAGE);
+	char *rname = argv[a];
+	int nattrs = atoi(argv[a+1]);
+	char *cv = argv[a+2];
+	if (nattrs < 2 || nattrs > MAXATTRS) fatal("Invalid #attrs");
+	if (existsRelation(rname)) fatal("Relation already exists");
+
+	// read the tuples, via a scratch relation that knows #attrs
+	create(rname, nattrs, cv, format, DEFPAGESIZE);
+	Reln r = openRelation(rname, "r");
+	Count n = 0, max = 1024;
+	Tuple t, *tuples = malloc(max*sizeof(Tuple));
+	assert(tuples != NULL);
+	while ((t = readTuple(r,stdin)) != NULL) {
+		if (n == max) {
+			max *= 2;
+			tuples = realloc(tuples, max*sizeof(Tuple));
+			assert(tuples != NULL);
+		}
+		tuples[n++] = t;
+	}
+	closeRelation(r);
+	removeRelation(rname);
+	if (n == 0) fatal("No tuples to insert");
+
+	// the same queries for every page size
+	char (*queries)[MAXTUPLEN] = malloc(nqueries*sizeof(*queries));
+	assert(queries != NULL);
+	srand(0);
+	for (int i = 0; i < nqueries; i++)
+		makeQuery(tuples[rand()%n], nattrs, i%nattrs, queries[i]);
+
+	printf("%d tuples, %d queries, %s pages\n", n, nqueries,
+	       formatName(format));
+	printf("%8s %8s %8s %12s %12s %12s\n", "pagesize", "buckets", "ovflow",
+	       "inserts/sec", "queries/sec", "pages/query");
+	for (Count size = MINPAGESIZE; size <= MAXPAGESIZE; size *= 2) {
+		create(rname, nattrs, cv, format, size);
+
+		// inserts, counting the time to write the pages out
+		double start = now();
+		r = openRelation(rname, "r+");
+		for (Count i = 0; i < n; i++)
+			if (addToRelation(r, tuples[i]) == NO_PAGE) fatal("Insert failed");
+		Count nbuckets = npages(r);
+		closeRelation(r);
+		double inserts = n/(now() - start);
+
+		r = openRelation(rname, "r");
+		Count novflow = filePages(ovflowFile(r), size);
+		long pages = 0;
+		start = now();
+		for (int i = 0; i < nqueries; i++) {
+			Query q = startQuery(r, queries[i]);
+			if (q == NULL) fatal("Bad query");
+			while (getNextTuple(q) != NULL) ;
+			pages += queryPagesRead(q);
+			closeQuery(q);
+		}
+		double lookups = nqueries/(now() - start);
+		closeRelation(r);
+		removeRelation(rname);
+
+		printf("%8d %8d %8d %12.0f %12.0f %12.1f\n", size, nbuckets, novflow,
+		       inserts, lookups, (double)pages/nqueries);
+	}
+
+	for (Count i = 0; i < n; i++) free(tuples[i]);
+	free(tuples); free(queries);
+	return 0;
+}
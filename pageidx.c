@@ -0,0 +1,164 @@
+// pageidx.c ... in-page tuple/field index
+// part of Multi-attribute Linear-hashed Files
+// Find all tuple boundaries and commas in a page in one pass
+
+#include <pthread.h>
+#include "defs.h"
+#include "page.h"
+#include "pageidx.h"
+
+// A page's data is a run of '\0'-terminated tuples, each made of
+//   comma-separated fields (see addToPage)
+// indexPage() records where every tuple starts and where every
+//   comma is, so that tuples and fields can then be located
+//   without looking at the bytes again
+// The vector kernels compare 16 (SSE2) or 32 (AVX2) bytes at a time
+//   against ',' and '\0' and walk the resulting bit masks;
+//   the best one the CPU supports is picked on first use,
+//   and the scalar loop is the fallback everywhere else
+
+// note one interesting byte at offset pos
+
+static inline void indexByte(PageIndex *ix, char c, Offset pos)
+{
+	if (c == ',')
+		ix->comma[ix->ncommas++] = pos;
+	else {
+		// end of tuple; next one starts after the '\0'
+		ix->ntuples++;
+		ix->start[ix->ntuples] = pos + 1;
+		ix->first[ix->ntuples] = ix->ncommas;
+	}
+}
+
+static void startIndex(PageIndex *ix)
+{
+	ix->ntuples = ix->ncommas = 0;
+	ix->start[0] = ix->first[0] = 0;
+}
+
+// byte-at-a-time version, from offset pos to the end of the tuples
+
+static void indexBytes(char *data, Offset pos, Offset used, PageIndex *ix)
+{
+	for (; pos < used; pos++)
+		if (data[pos] == ',' || data[pos] == '\0')
+			indexByte(ix, data[pos], pos);
+}
+
+void indexPageScalar(Page p, PageIndex *ix)
+{
+	startIndex(ix);
+	indexBytes(pageData(p), 0, pageUsed(p), ix);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+// walk the set bits of a block's match mask in position order
+
+static inline void indexMask(char *data, Offset base, unsigned int m, PageIndex *ix)
+{
+	while (m != 0) {
+		Offset pos = base + __builtin_ctz(m);
+		m &= m - 1;
+		indexByte(ix, data[pos], pos);
+	}
+}
+
+__attribute__((target("sse2")))
+static void indexPageSSE2(Page p, PageIndex *ix)
+{
+	char *data = pageData(p);
+	Offset used = pageUsed(p), pos = 0;
+	__m128i commas = _mm_set1_epi8(','), zeros = _mm_setzero_si128();
+	startIndex(ix);
+	for (; pos + 16 <= used; pos += 16) {
+		__m128i b = _mm_loadu_si128((__m128i *)(data + pos));
+		__m128i hit = _mm_or_si128(_mm_cmpeq_epi8(b, commas),
+		                           _mm_cmpeq_epi8(b, zeros));
+		indexMask(data, pos, _mm_movemask_epi8(hit), ix);
+	}
+	indexBytes(data, pos, used, ix);
+}
+
+__attribute__((target("avx2")))
+static void indexPageAVX2(Page p, PageIndex *ix)
+{
+	char *data = pageData(p);
+	Offset used = pageUsed(p), pos = 0;
+	__m256i commas = _mm256_set1_epi8(','), zeros = _mm256_setzero_si256();
+	startIndex(ix);
+	for (; pos + 32 <= used; pos += 32) {
+		__m256i b = _mm256_loadu_si256((__m256i *)(data + pos));
+		__m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(b, commas),
+		                              _mm256_cmpeq_epi8(b, zeros));
+		indexMask(data, pos, (unsigned int)_mm256_movemask_epi8(hit), ix);
+	}
+	indexBytes(data, pos, used, ix);
+}
+
+static void (*kernel)(Page, PageIndex *) = NULL;
+static char *kernelName = NULL;
+
+static void chooseKernel(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernel = indexPageAVX2; kernelName = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2")) {
+		kernel = indexPageSSE2; kernelName = "sse2";
+	}
+	else {
+		kernel = indexPageScalar; kernelName = "scalar";
+	}
+}
+
+#else
+
+static void (*kernel)(Page, PageIndex *) = indexPageScalar;
+static char *kernelName = "scalar";
+
+static void chooseKernel(void) { }
+
+#endif
+
+// the kernel is chosen once, by whichever thread first needs it;
+//   query workers index pages at the same time
+static pthread_once_t chosen = PTHREAD_ONCE_INIT;
+
+// build the index for a page using the best available kernel
+
+void indexPage(Page p, PageIndex *ix)
+{
+	pthread_once(&chosen, chooseKernel);
+	kernel(p, ix);
+}
+
+// name of the kernel indexPage() uses
+
+char *pageIndexKernel()
+{
+	pthread_once(&chosen, chooseKernel);
+	return kernelName;
+}
+
+// fill in views of the fields of tuple t (relative to its start)
+// returns the number of fields in the tuple
+
+Count indexTupleAttrs(PageIndex *ix, Count t, AttrView *vals, Count max)
+{
+	Offset base = ix->start[t], end = ix->start[t+1] - 1;
+	Count nc = ix->first[t+1] - ix->first[t];
+	PageOffset *c = &ix->comma[ix->first[t]];
+	Offset from = base;
+	for (Count i = 0; i <= nc && i < max; i++) {
+		Offset to = (i < nc) ? c[i] : end;
+		vals[i].off = from - base;
+		vals[i].len = to - from;
+		from = to + 1;
+	}
+	return nc + 1;
+}
@@ -0,0 +1,34 @@
+// pageidx.h ... interface to in-page tuple/field index
+// part of Multi-attribute Linear-hashed Files
+// See pageidx.c for details of building a PageIndex
+
+#ifndef PAGEIDX_H
+#define PAGEIDX_H 1
+
+#include "defs.h"
+#include "page.h"
+#include "tuple.h"
+
+// each tuple takes at least two bytes ("x\0")
+// an index has room for a page of any size
+#define MAXPAGETUPS (MAXPAGESIZE/2)
+
+typedef unsigned short PageOffset;
+
+// positions of tuples and field separators in a page's data
+// - tuple t occupies data[start[t] .. start[t+1]-2], then '\0'
+// - its commas are comma[first[t] .. first[t+1]-1]
+typedef struct {
+	Count ntuples;
+	Count ncommas;
+	PageOffset start[MAXPAGETUPS+1];
+	PageOffset first[MAXPAGETUPS+1];
+	PageOffset comma[MAXPAGESIZE];
+} PageIndex;
+
+void indexPage(Page p, PageIndex *ix);
+void indexPageScalar(Page p, PageIndex *ix);
+Count indexTupleAttrs(PageIndex *ix, Count t, AttrView *vals, Count max);
+char *pageIndexKernel();
+
+#endif
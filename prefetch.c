@@ -0,0 +1,235 @@
+// prefetch.c ... asynchronous bucket prefetching
+// part of Multi-attribute Linear-hashed Files
+// Read the pages of upcoming buckets ahead of a scan
+
+#include <pthread.h>
+#include "defs.h"
+#include "prefetch.h"
+#include "reln.h"
+#include "page.h"
+#include "bufpool.h"
+
+#define NPREFETCHERS 4  // I/O threads per prefetcher
+
+// A Prefetch reads the chains of a known list of buckets ahead
+//   of the consumer, which takes their pages in order
+// - up to depth buckets are in progress at once; each has its
+//   primary page read queued as soon as it enters the window
+// - when a page arrives, a read of its overflow page (if any) is
+//   queued straight away, so a chain is followed as fast as the
+//   reads complete; each bucket has at most one read queued
+// - reads are done by a small pool of I/O threads, which pin each
+//   page in the relation's buffer pool, copy it into a private
+//   buffer and unpin it, so the consumer never waits on a seek
+// - going through the pool means the prefetcher sees the same
+//   pages as everyone else: frames not yet written back, and pages
+//   that a logged relation has so far written only to its log
+// - stalls counts the times the consumer had to wait for a page
+
+typedef struct PfPage {
+	Page   page;
+	struct PfPage *next;
+} PfPage;
+
+typedef struct {
+	PfPage *head, *tail;  // pages fetched so far, in chain order
+	Bool   complete;      // last page of chain has been fetched
+	Count  ntaken;        // pages handed to consumer
+} PfBucket;
+
+typedef struct {
+	Count  slot;          // window slot of bucket
+	Bool   ovflow;        // read from ovflow file?
+	PageID pid;           // page to read
+} PfRequest;
+
+struct PrefetchRep {
+	BufPool pool;         // relation's buffer pool
+	FILE  *data, *ovflow; // relation's files
+	Count  pagesize;      // bytes in each page
+	PageID *buckets;      // buckets to fetch, in consumer order
+	Count  nbuckets;
+	Count  depth;         // buckets in progress at once
+	PfBucket *win;        // bucket k lives in win[k % depth]
+	Count  head;          // bucket being consumed
+	Count  issued;        // buckets that have entered the window
+	PfRequest *reqs;      // ring of queued reads (<= depth)
+	Count  rfirst, nreqs;
+	Page   cur;           // page last handed to consumer
+	Count  stalls;        // waits by the consumer
+	Bool   quit;
+	pthread_t threads[NPREFETCHERS];
+	pthread_mutex_t lock;
+	pthread_cond_t  work;     // a read has been queued
+	pthread_cond_t  arrived;  // a page has been fetched
+};
+
+static void *prefetcher(void *arg);
+
+// queue a read; caller holds the lock
+
+static void queueRead(Prefetch pf, Count slot, Bool ovflow, PageID pid)
+{
+	assert(pf->nreqs < pf->depth);
+	PfRequest *rq = &pf->reqs[(pf->rfirst + pf->nreqs++) % pf->depth];
+	rq->slot = slot; rq->ovflow = ovflow; rq->pid = pid;
+	pthread_cond_signal(&pf->work);
+}
+
+// bring the next bucket into the window; caller holds the lock
+
+static void issueBucket(Prefetch pf)
+{
+	Count slot = pf->issued % pf->depth;
+	PfBucket *b = &pf->win[slot];
+	b->head = b->tail = NULL;
+	b->complete = FALSE;
+	b->ntaken = 0;
+	queueRead(pf, slot, FALSE, pf->buckets[pf->issued++]);
+}
+
+// start fetching the chains of buckets[0..nbuckets-1]
+
+Prefetch startPrefetch(Reln r, PageID *buckets, Count nbuckets, Count depth)
+{
+	assert(depth > 0);
+	Prefetch pf = malloc(sizeof(struct PrefetchRep));
+	assert(pf != NULL);
+	pf->pool = bufPool(r);
+	pf->data = dataFile(r);
+	pf->ovflow = ovflowFile(r);
+	pf->pagesize = pageSize(r);
+	pf->buckets = buckets;
+	pf->nbuckets = nbuckets;
+	pf->depth = depth;
+	pf->win = malloc(depth*sizeof(PfBucket));
+	pf->reqs = malloc(depth*sizeof(PfRequest));
+	assert(pf->win != NULL && pf->reqs != NULL);
+	pf->head = pf->issued = 0;
+	pf->rfirst = pf->nreqs = 0;
+	pf->cur = NULL;
+	pf->stalls = 0;
+	pf->quit = FALSE;
+	pthread_mutex_init(&pf->lock, NULL);
+	pthread_cond_init(&pf->work, NULL);
+	pthread_cond_init(&pf->arrived, NULL);
+
+	pthread_mutex_lock(&pf->lock);
+	while (pf->issued < nbuckets && pf->issued < depth) issueBucket(pf);
+	pthread_mutex_unlock(&pf->lock);
+	for (int i = 0; i < NPREFETCHERS; i++)
+		if (pthread_create(&pf->threads[i], NULL, prefetcher, pf) != 0)
+			fatal("Can't start prefetch thread");
+	return pf;
+}
+
+// I/O thread: perform queued reads, following overflow links
+
+static void *prefetcher(void *arg)
+{
+	Prefetch pf = arg;
+	pthread_mutex_lock(&pf->lock);
+	for (;;) {
+		while (pf->nreqs == 0 && !pf->quit)
+			pthread_cond_wait(&pf->work, &pf->lock);
+		if (pf->quit) break;
+		PfRequest rq = pf->reqs[pf->rfirst];
+		pf->rfirst = (pf->rfirst + 1) % pf->depth;
+		pf->nreqs--;
+		pthread_mutex_unlock(&pf->lock);
+
+		PfPage *pp = malloc(sizeof(PfPage));
+		assert(pp != NULL);
+		pp->page = malloc(pf->pagesize);
+		assert(pp->page != NULL);
+		pp->next = NULL;
+		FILE *f = rq.ovflow ? pf->ovflow : pf->data;
+		Page p = pinPage(pf->pool, f, rq.pid);
+		memcpy(pp->page, p, pf->pagesize);
+		unpinPage(pf->pool, p, FALSE);
+
+		pthread_mutex_lock(&pf->lock);
+		PfBucket *b = &pf->win[rq.slot];
+		if (b->tail == NULL) b->head = pp; else b->tail->next = pp;
+		b->tail = pp;
+		PageID next = pageOvflow(pp->page);
+		if (next == NO_PAGE)
+			b->complete = TRUE;
+		else
+			queueRead(pf, rq.slot, TRUE, next);
+		pthread_cond_broadcast(&pf->arrived);
+	}
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+// next page for the consumer: each bucket's chain in turn
+// sets *ovflow if it is an overflow page; returns NULL at the end
+// the page is valid until the next call
+
+Page nextPrefetchPage(Prefetch pf, Bool *ovflow)
+{
+	pthread_mutex_lock(&pf->lock);
+	if (pf->cur != NULL) free(pf->cur);
+	pf->cur = NULL;
+	Bool waited = FALSE;
+	while (pf->head < pf->nbuckets) {
+		PfBucket *b = &pf->win[pf->head % pf->depth];
+		if (b->head != NULL) {
+			PfPage *pp = b->head;
+			b->head = pp->next;
+			if (b->head == NULL) b->tail = NULL;
+			*ovflow = (b->ntaken++ > 0);
+			pf->cur = pp->page;
+			free(pp);
+			break;
+		}
+		if (b->complete) {
+			// bucket finished; slide the window along
+			pf->head++;
+			if (pf->issued < pf->nbuckets) issueBucket(pf);
+			continue;
+		}
+		if (!waited) pf->stalls++;
+		waited = TRUE;
+		pthread_cond_wait(&pf->arrived, &pf->lock);
+	}
+	Page p = pf->cur;
+	pthread_mutex_unlock(&pf->lock);
+	return p;
+}
+
+Count prefetchStalls(Prefetch pf)
+{
+	pthread_mutex_lock(&pf->lock);
+	Count n = pf->stalls;
+	pthread_mutex_unlock(&pf->lock);
+	return n;
+}
+
+// stop the I/O threads and release everything
+
+void closePrefetch(Prefetch pf)
+{
+	pthread_mutex_lock(&pf->lock);
+	pf->quit = TRUE;
+	pthread_cond_broadcast(&pf->work);
+	pthread_mutex_unlock(&pf->lock);
+	for (int i = 0; i < NPREFETCHERS; i++)
+		pthread_join(pf->threads[i], NULL);
+	for (Count k = pf->head; k < pf->issued; k++) {
+		PfBucket *b = &pf->win[k % pf->depth];
+		while (b->head != NULL) {
+			PfPage *pp = b->head;
+			b->head = pp->next;
+			free(pp->page);
+			free(pp);
+		}
+	}
+	if (pf->cur != NULL) free(pf->cur);
+	pthread_mutex_destroy(&pf->lock);
+	pthread_cond_destroy(&pf->work);
+	pthread_cond_destroy(&pf->arrived);
+	free(pf->win); free(pf->reqs);
+	free(pf);
+}
@@ -0,0 +1,19 @@
+// prefetch.h ... interface to asynchronous bucket prefetching
+// part of Multi-attribute Linear-hashed Files
+// See prefetch.c for details of Prefetch type and functions
+
+#ifndef PREFETCH_H
+#define PREFETCH_H 1
+
+typedef struct PrefetchRep *Prefetch;
+
+#include "defs.h"
+#include "reln.h"
+#include "page.h"
+
+Prefetch startPrefetch(Reln r, PageID *buckets, Count nbuckets, Count depth);
+Page nextPrefetchPage(Prefetch pf, Bool *ovflow);
+Count prefetchStalls(Prefetch pf);
+void closePrefetch(Prefetch pf);
+
+#endif
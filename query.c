@@ -8,29 +8,81 @@
 #include "reln.h"
 #include "tuple.h"
 #include "hash.h"
+#include "scan.h"
+#include "prefetch.h"
+#include <pthread.h>
 
-#define TRUE 1
-#define FALSE 0
-// A suggestion ... you can change however you like
+#define QUEUESIZE 64  // max bucket results waiting for the consumer
+
+// one known attribute value from the query string
+typedef struct {
+	Count  att;    // attribute index
+	char  *val;    // value bytes (within qtuple)
+	Count  len;    // value length
+	Bits   hash;   // hash_any of value, as in page signatures
+	Bool   isint;  // an int attribute, compared as one word ...
+	unsigned long long word; // ... with this
+} QueryAttr;
 
 struct QueryRep {
 	Reln    rel;       // need to remember Relation info
 	Bits    known;     // the hash value from MAH
 	Bits    unknown;   // the unknown bits from MAH
-	PageID  curpage;   // current page in scan
-	int     is_ovflow; // are we in the overflow pages?
-	Offset  curtup;    // offset of current tuple within page
-	//TODO
-	// add struct attributes
-	int depth;    // linear hashing depth
-	Bits start;   // the begin value, pageId
-	Tuple qtuple; // string tuble
-
-	Count unnum;      // the count umber of unkown bits in specific depth level
-	Count ctuple;     // the count number of tuples gotten in current page
-	Bits unbits;    // current unknow bits change level 
+	Bits    mask;      // unknown bits that select a bucket
+	Bits    unbits;    // next assignment of the unknown bits
+	Bool    done;      // all candidate buckets visited
+	Scan    scan;      // position within current bucket
+	Tuple   qtuple;    // copy of query string
+
+	Count nknown;      // number of known attributes
+	QueryAttr *qattrs; // known attributes, in attribute order
+	Bits  sig[MAXSIGWORDS]; // page signature bits of known values
+
+	struct ExecRep *exec; // worker pool, if running in parallel
+	Prefetch pf;       // bucket reader, if prefetching
+	PageID *cands;     // candidate buckets being prefetched
 };
 
+// matching tuples from one bucket, produced by a worker
+
+typedef struct {
+	Count  n, max;
+	Tuple *tuples;    // private copies
+} ResultBatch;
+
+// parallel executor
+// - candidate buckets are listed up front and handed out in order,
+//   one at a time, to whichever worker is free
+// - each worker scans a whole bucket chain and posts its matches
+//   as one batch; batches wait in slots[] until consumed
+// - at most QUEUESIZE buckets may be taken but not yet consumed,
+//   so workers block when the consumer falls behind
+// - ordered output consumes batches in candidate order,
+//   otherwise in the order they complete (via done[])
+typedef struct ExecRep {
+	Query  query;
+	Count  nworkers;
+	pthread_t *workers;
+	Bool   ordered;      // output in bucket ID order?
+	PageID *cands;       // candidate buckets
+	Count  ncands;
+	Count  ntaken;       // candidates handed to workers
+	Count  nconsumed;    // batches finished with by consumer
+	ResultBatch **slots; // completed batch for each candidate
+	Count *done;         // candidates in order of completion
+	Count  ndone;
+	ResultBatch *cur;    // batch being returned to consumer
+	Count  curpos;       // next tuple within cur
+	Count  nread;        // pages read by workers
+	Count  nskipped;     // pages workers passed over
+	pthread_mutex_t lock;
+	pthread_cond_t  ready;  // a batch has been posted
+	pthread_cond_t  space;  // a batch has been consumed
+} Exec;
+
+static Bool nextBucket(Query q, PageID *bucket);
+static void *queryWorker(void *arg);
+
 // take a query string (e.g. "1234,?,abc,?")
 // set up a QueryRep object for the scan
 
@@ -38,178 +90,414 @@ Query startQuery(Reln r, char *q)
 {
 	Query new = malloc(sizeof(struct QueryRep));
 	assert(new != NULL);
-	// TODO
-	// Partial algorithm:
-	// form known bits from known attributes
-	// form unknown bits from '?' attributes
-	// compute PageID of first page
-	//   using known bits and first "unknown" value
-	// set all values in QueryRep object
-
-	// initialize for some attributes
-	new->is_ovflow = 0;
-	new->curtup = 0;
 	new->rel = r;
-	new->depth = depth(r);
-	new->ctuple = 0;
-	new->unbits = 0;
 
-	// preparation
-	char buf[MAXBITS+1];
+	// split query into attribute values
 	Count nvals = nattrs(r);
-	char *attr[nvals];
-	tupleVals(q, attr);
-
-	int cmp[nvals];
-	// create compare masks
-	Bits nknow = 0;
-	Bits comp = 0;
-	Bits hash[nvals];
-	Bits qknow = 0xFFFFFFFF;
-	for (int i = 0; i < nvals; i++) {
-		if (attr[i] == NULL) fatal("Wrong number of attribute");
-		cmp[i] = strcmp(attr[i], "?");
-		if (!cmp[i]) hash[i] = 0;
-		// hash
-		// equal
-		else hash[i] = hash_any((unsigned char *) attr[i], strlen(attr[i]));
-		bitsString(hash[i],buf);
+	AttrView attr[nvals];
+	if (tupleAttrs(q, attr, nvals) != nvals) {
+		free(new);
+		return NULL; // wrong number of attributes
 	}
 
-	// for known/unknown
-	ChVecItem *choiceVector = chvec(r);
-	for (int i = 0; i < MAXBITS; i++) {
-		// set
-		if (!cmp[choiceVector[i].att]) nknow = setBit(nknow, i);
-		// mask set
-		comp = 0;
-		comp = setBit(comp, choiceVector[i].bit);
-		if ((comp & hash[choiceVector[i].att]) == 0) qknow = unsetBit(qknow, i);
+	// known values are put in their stored form once, here: ints
+	//   in binary, dictionary values as codes; a value with no
+	//   code matches no tuple
+	Tuple given = q;
+	Bool nomatch = FALSE;
+	if (intAttrs(r) != 0 && (q = packTuple(r, given, TRUE)) == NULL) {
+		free(new);
+		return NULL; // an int attribute that isn't an int
 	}
-	bitsString(qknow,buf);
-	new->known = qknow;
-	new->unknown = nknow;
-	
-	comp = 0;
-	for (int i = 0; i < depth(r); i++) { comp = setBit(comp, i); }
-	Count rs = splitp(r);
-	// pageID set=> curr & start bucket value
-	PageID start = qknow & comp;
-	if (start < rs) {
-		new->depth++;
-		start = setBit(comp, depth(r)) & qknow;
+	if (dictionary(r) != NULL) {
+		Tuple enc = encodeTuple(dictionary(r), q, FALSE);
+		if (enc == NULL)
+			nomatch = TRUE;
+		else {
+			if (q != given) free(q);
+			q = enc;
+		}
 	}
-	new->curpage = start;
-	new->start = start;
-	// count unknow bits
-	int counts = 0;
-	int move = 1;
-	for (int i = 0; i < MAXBITS - 1; i++) {
-		if (i >= new->depth) break; // out of range
-		if (move & nknow) counts++;
-		move = move << 1;
+	tupleAttrs(q, attr, nvals);
+
+	// hash known attributes; unknown ones ("?") contribute
+	//   0 bits to the known hash and 1 bits to the unknown mask
+	Bool cmp[nvals];
+	Bits hash[nvals], unk[nvals];
+	for (int i = 0; i < nvals; i++) {
+		char *val = q + attr[i].off;
+		cmp[i] = !(attr[i].len == 1 && val[0] == '?');
+		hash[i] = cmp[i] ? attrHash(r, i, val, attr[i].len) : 0;
+		unk[i] = cmp[i] ? 0 : 0xFFFFFFFF;
 	}
-	new->unnum = counts;
+	new->known = chvecHash(chvecPlan(r), hash);
+	new->unknown = chvecHash(chvecPlan(r), unk);
+
+	// candidate buckets come from all settings of the unknown
+	//   bits among the lower depth+1 bits of the hash
+	new->mask = new->unknown & ((2u << depth(r)) - 1);
+	new->unbits = 0;
+	new->done = nomatch;
+	new->scan = NULL;
 	// compy query tuple string
 	new->qtuple = copyString(q);
+	if (q != given) free(q);
+
+	// compile the predicate: just the known attributes
+	new->qattrs = malloc(nvals*sizeof(QueryAttr));
+	assert(new->qattrs != NULL);
+	new->nknown = 0;
+	for (int i = 0; i < nvals; i++) {
+		if (!cmp[i]) continue;
+		QueryAttr *qa = &new->qattrs[new->nknown++];
+		qa->att = i;
+		qa->val = new->qtuple + attr[i].off;
+		qa->len = attr[i].len;
+		qa->hash = hash_any((unsigned char *)qa->val, qa->len);
+		qa->isint = bitIsSet(intAttrs(r), i) && qa->len == INTLEN;
+		qa->word = 0;
+		if (qa->isint) memcpy(&qa->word, qa->val, INTLEN);
+	}
+	memset(new->sig, 0, sizeof(new->sig));
+	for (Count k = 0; k < new->nknown; k++)
+		addToSignature(new->sig, new->qattrs[k].att, new->qattrs[k].hash, pageSize(r));
 
+	new->exec = NULL;
+	new->pf = NULL;
+	new->cands = NULL;
 	return new;
 }
+
+// step to the next candidate bucket for the query
+// a hash whose lower depth bits fall before the split pointer
+//   uses depth+1 bits; otherwise bit depth is not part of the
+//   bucket, and settings that only differ in it are skipped
+// returns FALSE when all candidates have been produced
+
+static Bool nextBucket(Query q, PageID *bucket)
+{
+	Count d = depth(q->rel);
+	Bits lower = (1u << d) - 1;
+	while (!q->done) {
+		Bits h = q->known | q->unbits;
+		// next subset of mask; wraps to 0 after the last one
+		q->unbits = (q->unbits - q->mask) & q->mask;
+		if (q->unbits == 0) q->done = TRUE;
+		if ((h & lower) < splitp(q->rel))
+			*bucket = h & (lower | (1u << d));
+		else if (bitIsSet(h, d) && bitIsSet(q->mask, d))
+			continue;
+		else
+			*bucket = h & lower;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+// check the tuple the scan is on against the compiled predicate
+// when the page holds tuple hashes, any hash bit that comes from
+//   a known attribute must agree with the query's known bits;
+//   values are only compared for tuples that pass that test
+// field positions come from the page index, so each known
+//   attribute is checked directly: values are compared
+//   only when their lengths agree, and ints as single words
+
+static Bool matchQuery(Query q, Scan s, Tuple t)
+{
+	Bits h;
+	if (scanTupleHash(s, &h) && ((h ^ q->known) & ~q->unknown) != 0)
+		return FALSE;
+	Count na = nattrs(q->rel);
+	AttrView vals[na];
+	Count nvals = scanTupleAttrs(s, vals, na);
+	if (nvals != na) return FALSE;
+	for (Count k = 0; k < q->nknown; k++) {
+		QueryAttr *qa = &q->qattrs[k];
+		AttrView *v = &vals[qa->att];
+		if (qa->isint) {
+			unsigned long long w = 0;
+			if (v->len != INTLEN) return FALSE;
+			memcpy(&w, t + v->off, INTLEN);
+			if (w != qa->word) return FALSE;
+			continue;
+		}
+		if (v->len != qa->len || memcmp(t + v->off, qa->val, qa->len) != 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// start a scan of bucket b, passing over pages that
+//   can't hold the known attribute values
+
+static Scan queryScan(Query q, PageID b)
+{
+	Scan s = startScan(q->rel, b);
+	if (q->nknown > 0) scanSetFilter(s, q->sig);
+	return s;
+}
+
 // get next tuple during a scan
+// the tuple points into the scan's current page, and is only
+//   valid until the next call; use copyTuple() to keep it
+
+static Tuple nextParallel(Exec *e);
 
 Tuple getNextTuple(Query q)
 {
-	// TODO
-	// Partial algorithm:
-	// if (more tuples in current page)
-	//    get next matching tuple from current page
-	// else if (current page has overflow)
-	//    move to overflow page
-	//    grab first matching tuple from page
-	// else
-	//    move to "next" bucket
-	//    grab first matching tuple from data page
-	// endif
-	// if (current page has no matching tuples)
-	//    go to next page (try again)
-	// endif
-	Reln r = q->rel;
-	// loop condtion for valid check
-	while (TRUE) {
-		// get file
-		FILE *f;
-		if (q->is_ovflow != 1) f = dataFile(r);
-		else f = ovflowFile(r);
-		// get current page and the corresponding tuple number
-		Page current = getPage(f, q->curpage);
-		int overflow = pageOvflow(current);
-		Count n = pageNTuples(current);
-
-		//scan the cur page until there is no left tuples
-		//return if find match
-		while (q->ctuple < n) {
-			Tuple next;
-			q->ctuple++;
-			next = nextTuple(f, q->curpage, q->curtup);
-			int check = tupleMatch(q->rel, q->qtuple, next);
-			q->curtup = q->curtup + strlen(next) + 1;
-			if (check) return next;
-			else free(next);
+	if (q->exec != NULL) return nextParallel(q->exec);
+	if (q->scan == NULL) {
+		// first call; position at first candidate bucket
+		PageID first;
+		if (!nextBucket(q, &first)) return NULL;
+		q->scan = queryScan(q, first);
+	}
+	for (;;) {
+		// rest of current page
+		Tuple t;
+		while ((t = nextScanTuple(q->scan)) != NULL)
+			if (matchQuery(q, q->scan, t)) return t;
+		// next page in bucket
+		if (nextScanPage(q->scan)) continue;
+		// a prefetching scan has already been through every bucket
+		if (q->pf != NULL) break;
+		// next candidate bucket
+		PageID b;
+		if (!nextBucket(q, &b)) break;
+		resetScan(q->scan, b);
+	}
+	return NULL;
+}
+
+static int cmpPageID(const void *a, const void *b)
+{
+	PageID x = *(const PageID *)a, y = *(const PageID *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+// list all remaining candidate buckets; sets *n to their number
+
+static PageID *listCandidates(Query q, Count *n)
+{
+	Count max = 64;
+	PageID *cands = malloc(max*sizeof(PageID));
+	assert(cands != NULL);
+	*n = 0;
+	PageID b;
+	while (nextBucket(q, &b)) {
+		if (*n == max) {
+			max *= 2;
+			cands = realloc(cands, max*sizeof(PageID));
+			assert(cands != NULL);
 		}
+		cands[(*n)++] = b;
+	}
+	return cands;
+}
 
-		// check overflow
-		// switch to next page
-		if (overflow == -1) {
-			// mask for set & compare
-			Bits setM = 0;
-			Bits uknow = q->unknown;
-			int unnums = q->unnum;
-			Bits uncount = q->unbits;
-
-			// eg: 1 << 1 => 0b00000010
-			int new_mask = 1 << unnums;
-
-			// check condition
-			// current unknow bits is equal or larger
-			uncount++;
-			if (new_mask <= uncount) {
-				break;
-			}
-			// bit set position
-			int pos = 0;
-			for (int i = 0; i < unnums; i++) {
-				while (!((setBit(0, pos) & uknow)))pos++;
-				if (setBit(0, i) & uncount) setM = setBit(setM, pos);
-				pos++;
-			}
-			// check  pages and mask
-			if((npages(r)-1) < (q->start | setM)  )
-				break;
-			// updates attributes
-			q->curpage = q->start | setM;
-			q->is_ovflow = 0;
-			q->curtup = 0;
-			q->ctuple = 0;
-			q->unbits = uncount;
-
-		} else { // not -1 
-			// updates attributes
-			Offset ov = pageOvflow(current);
-			q->is_ovflow = 1;
-			q->curtup = 0;
-			q->ctuple = 0;
-			q->curpage = ov;
+// read candidate buckets ahead of the scan, up to depth at a time
+// must be called before the first getNextTuple()
+
+void prefetchQuery(Query q, Count depth)
+{
+	assert(q->exec == NULL && q->scan == NULL);
+	if (depth < 1) return;
+	Count n;
+	q->cands = listCandidates(q, &n);
+	q->pf = startPrefetch(q->rel, q->cands, n, depth);
+	q->scan = startPrefetchScan(q->rel, q->pf);
+	if (q->nknown > 0) scanSetFilter(q->scan, q->sig);
+}
+
+// run the rest of the query on a pool of worker threads
+// must be called before the first getNextTuple()
+// ordered = TRUE gives results bucket by bucket in bucket ID order
+
+void parallelQuery(Query q, Count nworkers, Bool ordered)
+{
+	assert(q->exec == NULL && q->scan == NULL);
+	if (nworkers < 1) return;
+	Exec *e = malloc(sizeof(Exec));
+	assert(e != NULL);
+	e->query = q;
+	e->ordered = ordered;
+
+	e->cands = listCandidates(q, &e->ncands);
+	if (ordered) qsort(e->cands, e->ncands, sizeof(PageID), cmpPageID);
+
+	e->slots = calloc(e->ncands + 1, sizeof(ResultBatch *));
+	e->done = malloc((e->ncands + 1)*sizeof(Count));
+	assert(e->slots != NULL && e->done != NULL);
+	e->ntaken = e->nconsumed = e->ndone = 0;
+	e->cur = NULL; e->curpos = 0;
+	e->nread = e->nskipped = 0;
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->ready, NULL);
+	pthread_cond_init(&e->space, NULL);
+
+	q->exec = e;
+	e->nworkers = nworkers;
+	e->workers = malloc(nworkers*sizeof(pthread_t));
+	assert(e->workers != NULL);
+	for (Count i = 0; i < nworkers; i++)
+		if (pthread_create(&e->workers[i], NULL, queryWorker, e) != 0)
+			fatal("Can't start query worker");
+}
+
+// scan candidate buckets until there are none left
+
+static void *queryWorker(void *arg)
+{
+	Exec *e = arg;
+	Query q = e->query;
+	Scan s = NULL;
+
+	pthread_mutex_lock(&e->lock);
+	while (e->ntaken < e->ncands) {
+		if (e->ntaken - e->nconsumed >= QUEUESIZE) {
+			pthread_cond_wait(&e->space, &e->lock);
 			continue;
 		}
+		Count i = e->ntaken++;
+		pthread_mutex_unlock(&e->lock);
+
+		ResultBatch *rb = malloc(sizeof(ResultBatch));
+		assert(rb != NULL);
+		rb->n = 0; rb->max = 0; rb->tuples = NULL;
+		if (s == NULL) s = queryScan(q, e->cands[i]);
+		else resetScan(s, e->cands[i]);
+		Count before = scanPagesRead(s);
+		Count skipped = scanPagesSkipped(s);
+		while (nextScanPage(s)) {
+			Tuple t;
+			while ((t = nextScanTuple(s)) != NULL) {
+				if (!matchQuery(q, s, t)) continue;
+				if (rb->n == rb->max) {
+					rb->max = (rb->max == 0) ? 16 : 2*rb->max;
+					rb->tuples = realloc(rb->tuples, rb->max*sizeof(Tuple));
+					assert(rb->tuples != NULL);
+				}
+				rb->tuples[rb->n++] = copyTuple(t);
+			}
+		}
+
+		pthread_mutex_lock(&e->lock);
+		e->nread += scanPagesRead(s) - before;
+		e->nskipped += scanPagesSkipped(s) - skipped;
+		e->slots[i] = rb;
+		e->done[e->ndone++] = i;
+		pthread_cond_broadcast(&e->ready);
 	}
-	// next get nothing
+	pthread_mutex_unlock(&e->lock);
+	if (s != NULL) closeScan(s);
 	return NULL;
 }
 
+static void freeBatch(ResultBatch *rb)
+{
+	for (Count i = 0; i < rb->n; i++) free(rb->tuples[i]);
+	free(rb->tuples);
+	free(rb);
+}
+
+// next result from the workers
+// tuple is valid until the next call, as for serial scans
+
+static Tuple nextParallel(Exec *e)
+{
+	for (;;) {
+		if (e->cur != NULL && e->curpos < e->cur->n)
+			return e->cur->tuples[e->curpos++];
+		pthread_mutex_lock(&e->lock);
+		if (e->cur != NULL) {
+			freeBatch(e->cur);
+			e->cur = NULL;
+			e->nconsumed++;
+			pthread_cond_broadcast(&e->space);
+		}
+		if (e->nconsumed == e->ncands) {
+			pthread_mutex_unlock(&e->lock);
+			return NULL;
+		}
+		// next batch: in candidate order, or in completion order
+		Count i = e->ordered ? e->nconsumed : 0;
+		if (e->ordered)
+			while (e->slots[i] == NULL)
+				pthread_cond_wait(&e->ready, &e->lock);
+		else {
+			while (e->ndone == e->nconsumed)
+				pthread_cond_wait(&e->ready, &e->lock);
+			i = e->done[e->nconsumed];
+		}
+		e->cur = e->slots[i];
+		e->slots[i] = NULL;
+		e->curpos = 0;
+		pthread_mutex_unlock(&e->lock);
+	}
+}
+
+// wait for the workers and release the executor
+
+static void closeExec(Exec *e)
+{
+	pthread_mutex_lock(&e->lock);
+	e->ncands = e->ntaken; // no more work to hand out
+	pthread_cond_broadcast(&e->space);
+	pthread_mutex_unlock(&e->lock);
+	for (Count i = 0; i < e->nworkers; i++)
+		pthread_join(e->workers[i], NULL);
+	if (e->cur != NULL) freeBatch(e->cur);
+	for (Count i = 0; i < e->ncands; i++)
+		if (e->slots[i] != NULL) freeBatch(e->slots[i]);
+	pthread_mutex_destroy(&e->lock);
+	pthread_cond_destroy(&e->ready);
+	pthread_cond_destroy(&e->space);
+	free(e->workers); free(e->cands);
+	free(e->slots); free(e->done);
+	free(e);
+}
+
+// number of pages read by the query so far
+
+Count queryPagesRead(Query q)
+{
+	if (q->exec != NULL) {
+		pthread_mutex_lock(&q->exec->lock);
+		Count n = q->exec->nread;
+		pthread_mutex_unlock(&q->exec->lock);
+		return n;
+	}
+	return (q->scan == NULL) ? 0 : scanPagesRead(q->scan);
+}
+
+// number of pages the query passed over using page signatures
+
+Count queryPagesSkipped(Query q)
+{
+	if (q->exec != NULL) {
+		pthread_mutex_lock(&q->exec->lock);
+		Count n = q->exec->nskipped;
+		pthread_mutex_unlock(&q->exec->lock);
+		return n;
+	}
+	return (q->scan == NULL) ? 0 : scanPagesSkipped(q->scan);
+}
+
+// number of times the scan waited for a prefetched page
+
+Count queryStalls(Query q)
+{
+	return (q->pf == NULL) ? 0 : prefetchStalls(q->pf);
+}
+
 // clean up a QueryRep object and associated data
 void closeQuery(Query q)
 {
-	// TODO
+	if (q->exec != NULL) closeExec(q->exec);
+	if (q->scan != NULL) closeScan(q->scan);
+	if (q->pf != NULL) closePrefetch(q->pf);
+	free(q->cands);
+	free(q->qattrs);
+	free(q->qtuple);
 	free(q);
-
 }
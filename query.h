@@ -13,6 +13,11 @@ typedef struct QueryRep *Query;
 
 Query startQuery(Reln, char *);
 Tuple getNextTuple(Query);
+void parallelQuery(Query, Count nworkers, Bool ordered);
+void prefetchQuery(Query, Count depth);
+Count queryPagesRead(Query);
+Count queryPagesSkipped(Query);
+Count queryStalls(Query);
 void closeQuery(Query);
 
 #endif
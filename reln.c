@@ -9,31 +9,148 @@
 #include "chvec.h"
 #include "bits.h"
 #include "hash.h"
+#include "bufpool.h"
+#include "wal.h"
+#include "dict.h"
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
 
 #define HEADERSIZE (3*sizeof(Count)+sizeof(Offset))
 
+// per-bucket hints, saved in rel.tails
+// lets inserts go straight to the end of an overflow chain
+
+typedef struct {
+	PageID tail;   // last overflow page in chain (NO_PAGE if none)
+	Count  free;   // free bytes in the last page of the chain
+	Count  nov;    // number of overflow pages in chain
+} BucketInfo;
+
+// buckets are kept in fixed-size segments, which never move once
+//   allocated, so a thread can use its bucket while others add more
+// each bucket has a latch, held by anyone changing its chain
+
+#define SEGSIZE 1024
+#define MAXSEGS 65536
+
+typedef struct {
+	BucketInfo hint;       // chain hints
+	pthread_mutex_t latch; // protects the bucket's pages and hint
+} Bucket;
+
+// a bucket chain being written by a split
+// tuples are collected in buf, which is written out to page pid
+//   when it is full (and the chain extended) or the split ends
+
+typedef struct {
+	FILE  *f;      // file that page pid is in
+	PageID pid;    // where buf will be written
+	PageID tail;   // last overflow page so far (NO_PAGE if none)
+	Count  nov;    // overflow pages so far
+	Page   buf;    // contents of page pid
+} ChainOut;
+
+// a split under way; see startSplit()
+
+typedef struct {
+	Bool   active;   // is a bucket being split?
+	PageID old;      // bucket being split (the split pointer)
+	PageID buddy;    // bucket its tuples are shared with
+	FILE  *f;        // file that page next is in
+	PageID next;     // next page of the old chain (NO_PAGE if all read)
+	ChainOut out[2]; // new chains for old and buddy buckets
+} SplitState;
+
 struct RelnRep {
 	Count  nattrs; // number of attributes
 	Count  depth;  // depth of main data file
 	Offset sp;     // split pointer
     Count  npages; // number of main data pages
-    Count  ntups;  // total number of tuples
+    BigCount ntups; // total number of tuples
 	ChVec  cv;     // choice vector
+	ChVecPlan plan; // choice vector compiled for hashing
+	PageFormat format; // layout of data/ovflow pages
+	Count  pagesize;  // bytes in each data/ovflow page
 	char   mode;   // open for read/write
 	FILE  *info;   // handle on info file
 	FILE  *data;   // handle on data file
 	FILE  *ovflow; // handle on ovflow file
+	BufPool pool;  // cached pages from data/ovflow files
+	FILE  *tails;  // handle on tails file (write mode only)
+	Bucket *segs[MAXSEGS]; // buckets, SEGSIZE to a segment
+	Count  nsegs;     // #segments allocated
+	PageID freeovf;   // first free overflow page (NO_PAGE if none)
+	Count  novpages;  // number of overflow pages
+	PageID vacpos;    // next bucket for vacuumRelation()
+	Count  policy;    // when to split (SPLIT_EVERY, ...)
+	Count  param;     // ... and the policy's setting
+	BigCount nbytes;  // space used by tuples, as for tupleSpace()
+	Bits   intattrs;  // attributes that hold ints
+	Bits   dictattrs; // attributes stored dictionary-encoded
+	Dict   dict;      // their dictionaries (NULL if none)
+	SplitState split; // bucket split in progress
+	Count  debt;      // splits due but not yet started
+	Bool   bgsplit;   // are splits left to the splitter thread?
+	Bool   stopping;  // splitter should finish up and exit
+	pthread_t splitter;
+	pthread_mutex_t lock;  // protects the fields above, other than
+	                       //   the buckets and the split's chains
+	pthread_mutex_t splitlock; // held by whoever is splitting
+	pthread_mutex_t ovlock;    // protects the overflow free list
+	pthread_cond_t  owed;  // debt has been recorded
+	char  *name;      // relation name
+	WAL    wal;       // write-ahead log (NULL if not logged)
+	Count  interval;  // ms between commits
+	double lastcommit;   // when the last commit finished
+	Bool   committing;   // is a commit being done?
+	Bool   pausing;      // is a commit waiting for updates to stop?
+	Count  nupdating;    // updates under way
+	pthread_cond_t idle;   // updates have stopped
+	pthread_cond_t resume; // updates may go on
 };
 
+// the part of the header that updates change, as logged by commits
+
+typedef struct {
+	BigCount ntups, nbytes;
+	Count  depth, sp, npages, novpages;
+	PageID freeovf, vacpos;
+} Snapshot;
+
+// locks are taken in the order: splitlock, bucket latches (lower
+//   bucket first), lock, ovlock; lock is only held briefly
+
+static void growBuckets(Reln r);
+static BucketInfo *hint(Reln r, PageID b);
+static void loadBuckets(Reln r, char *name);
+static void initRuntime(Reln r, char *name);
+static void recoverRelation(char *name);
+static void beginUpdate(Reln r);
+static void endUpdate(Reln r);
+static void maybeCommit(Reln r);
+static void commit(Reln r, Bool checkpoint);
+static void payDebt(Reln r, Bool all);
+static void addToChain(Reln r, ChainOut *c, Tuple t, Bits h);
+
 // create a new relation (three files)
 
-Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv)
+Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv,
+                   PageFormat format, Count pagesize, Count policy, Count param,
+                   Bits intattrs, Bits dictattrs)
 {
     char fname[MAXFILENAME];
+	if (!validPageSize(pagesize)) return ~OK;
 	Reln r = malloc(sizeof(struct RelnRep));
+	assert(r != NULL);
 	r->nattrs = nattrs; r->depth = d; r->sp = 0;
 	r->npages = npages; r->ntups = 0; r->mode = 'w';
-	assert(r != NULL);
+	r->format = format;
+	r->pagesize = pagesize;
+	r->policy = policy; r->param = param;
+	r->nbytes = 0;
+	r->intattrs = intattrs;
+	r->dictattrs = dictattrs;
 	if (parseChVec(r, cv, r->cv) != OK) return ~OK;
 	sprintf(fname,"%s.info",name);
 	r->info = fopen(fname,"w");
@@ -44,8 +161,29 @@ Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv)
 	sprintf(fname,"%s.ovflow",name);
 	r->ovflow = fopen(fname,"w");
 	assert(r->ovflow != NULL);
+	sprintf(fname,"%s.tails",name);
+	r->tails = fopen(fname,"w");
+	assert(r->tails != NULL);
+	if (dictattrs != 0 && newDict(name) != OK) return ~OK;
+	r->dict = (dictattrs != 0) ? openDict(name, dictattrs, 'w') : NULL;
+	r->pool = newBufPool(NBUFS, r->pagesize);
+	r->plan = compileChVec(r->cv);
 	int i;
-	for (i = 0; i < npages; i++) addPage(r->data);
+	for (i = 0; i < npages; i++) addPage(r->data, r->pagesize);
+	r->nsegs = 0;
+	r->freeovf = NO_PAGE;
+	r->novpages = 0;
+	r->vacpos = 0;
+	initRuntime(r, name);
+	growBuckets(r);
+	Page empty = newPage(r->pagesize);
+	for (i = 0; i < npages; i++) {
+		BucketInfo *bk = hint(r, i);
+		bk->tail = NO_PAGE;
+		bk->free = pageFreeSpace(empty, format, pagesize);
+		bk->nov = 0;
+	}
+	free(empty);
 	closeRelation(r);
 	return 0;
 }
@@ -65,11 +203,225 @@ Bool existsRelation(char *name)
 	}
 }
 
+// make sure there are entries for all buckets
+
+static void growBuckets(Reln r)
+{
+	while (r->nsegs*SEGSIZE < r->npages) {
+		if (r->nsegs == MAXSEGS) fatal("Too many buckets");
+		Bucket *seg = malloc(SEGSIZE*sizeof(Bucket));
+		assert(seg != NULL);
+		for (Count i = 0; i < SEGSIZE; i++)
+			pthread_mutex_init(&seg[i].latch, NULL);
+		r->segs[r->nsegs++] = seg;
+	}
+}
+
+static void freeBuckets(Reln r)
+{
+	for (Count s = 0; s < r->nsegs; s++) {
+		for (Count i = 0; i < SEGSIZE; i++)
+			pthread_mutex_destroy(&r->segs[s][i].latch);
+		free(r->segs[s]);
+	}
+	r->nsegs = 0;
+}
+
+static BucketInfo *hint(Reln r, PageID b)
+{
+	return &r->segs[b/SEGSIZE][b%SEGSIZE].hint;
+}
+
+static pthread_mutex_t *latch(Reln r, PageID b)
+{
+	return &r->segs[b/SEGSIZE][b%SEGSIZE].latch;
+}
+
+// rebuild the chain hints by walking every bucket
+
+static void scanBuckets(Reln r)
+{
+	growBuckets(r);
+	for (PageID b = 0; b < r->npages; b++) {
+		Page p = pinPage(r->pool, r->data, b);
+		BucketInfo *bk = hint(r, b);
+		bk->tail = NO_PAGE;
+		bk->nov = 0;
+		PageID ovp = pageOvflow(p);
+		while (ovp != NO_PAGE) {
+			unpinPage(r->pool, p, FALSE);
+			p = pinPage(r->pool, r->ovflow, ovp);
+			bk->tail = ovp;
+			bk->nov++;
+			ovp = pageOvflow(p);
+		}
+		bk->free = pageFreeSpace(p, r->format, r->pagesize);
+		unpinPage(r->pool, p, FALSE);
+	}
+}
+
+// read chain hints from rel.tails
+// relations without a usable tails file get one rebuilt
+
+static void loadBuckets(Reln r, char *name)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.tails",name);
+	growBuckets(r);
+	r->tails = fopen(fname,"r+");
+	PageID b = 0;
+	if (r->tails != NULL)
+		while (b < r->npages && fread(hint(r, b), sizeof(BucketInfo), 1, r->tails) == 1)
+			b++;
+	if (b == r->npages) return;
+	if (r->tails == NULL) r->tails = fopen(fname,"w+");
+	assert(r->tails != NULL);
+	scanBuckets(r);
+}
+
+// rel.info holds the header of a relation
+// since version 2 it starts with INFO_MAGIC and a version number,
+//   then has every field at its full size (tuple and byte counts
+//   are 64 bits); older headers start straight in with #attrs,
+//   have 32-bit counts, and may stop short of later fields
+// version 3 adds the set of dictionary-encoded attributes, and
+//   version 4 the set of int attributes (before it, all strings),
+//   and version 5 the number of overflow pages
+// an older header is upgraded when its relation is opened for
+//   writing; read-only opens just interpret it
+
+#define INFO_MAGIC   0x464c484d  // "MHLF"
+#define INFO_VERSION 5
+
+static void getInfo(Reln r, void *x, size_t size)
+{
+	if (fread(x, size, 1, r->info) != 1) fatal("Relation info is incomplete");
+}
+
+static void putInfo(Reln r, void *x, size_t size)
+{
+	int n = fwrite(x, size, 1, r->info);
+	assert(n == 1);
+}
+
+// read a version 1 header, which has already been started on
+
+static void loadOldInfo(Reln r, Count nattrs)
+{
+	Count core[4];  // depth, sp, npages, ntups
+	r->nattrs = nattrs;
+	getInfo(r, core, sizeof core);
+	r->depth = core[0]; r->sp = core[1]; r->npages = core[2]; r->ntups = core[3];
+	getInfo(r, r->cv, MAXCHVEC*sizeof(ChVecItem));
+	// relations from before page formats were recorded are packed
+	if (fread(&r->format, sizeof(PageFormat), 1, r->info) != 1)
+		r->format = PACKED_PAGES;
+	// ... and from before free lists, have no free pages
+	if (fread(&r->freeovf, sizeof(PageID), 1, r->info) != 1)
+		r->freeovf = NO_PAGE;
+	if (fread(&r->vacpos, sizeof(PageID), 1, r->info) != 1)
+		r->vacpos = 0;
+	// ... and from before split policies, split every so often
+	if (fread(&r->policy, sizeof(Count), 1, r->info) != 1 ||
+	    fread(&r->param, sizeof(Count), 1, r->info) != 1) {
+		r->policy = SPLIT_EVERY;
+		r->param = defaultSplitParam(SPLIT_EVERY, r->nattrs, r->format, DEFPAGESIZE);
+	}
+	Count nbytes;
+	r->nbytes = (fread(&nbytes, sizeof(Count), 1, r->info) == 1) ? nbytes : 0;
+	// ... and from before page sizes were chosen, have 1K pages
+	if (fread(&r->pagesize, sizeof(Count), 1, r->info) != 1)
+		r->pagesize = DEFPAGESIZE;
+	r->dictattrs = r->intattrs = 0;
+}
+
+// read the header of a relation from rel.info
+// returns the version it was written in
+
+static Count loadInfo(Reln r)
+{
+	Count first, version = 1;
+	fseek(r->info, 0, SEEK_SET);
+	getInfo(r, &first, sizeof(Count));
+	if (first != INFO_MAGIC)
+		loadOldInfo(r, first);
+	else {
+		getInfo(r, &version, sizeof(Count));
+		if (version > INFO_VERSION) fatal("Relation is from a newer version");
+		getInfo(r, &r->nattrs, sizeof(Count));
+		getInfo(r, &r->depth, sizeof(Count));
+		getInfo(r, &r->sp, sizeof(Offset));
+		getInfo(r, &r->npages, sizeof(Count));
+		getInfo(r, &r->ntups, sizeof(BigCount));
+		getInfo(r, r->cv, MAXCHVEC*sizeof(ChVecItem));
+		getInfo(r, &r->format, sizeof(PageFormat));
+		getInfo(r, &r->pagesize, sizeof(Count));
+		getInfo(r, &r->freeovf, sizeof(PageID));
+		getInfo(r, &r->vacpos, sizeof(PageID));
+		getInfo(r, &r->policy, sizeof(Count));
+		getInfo(r, &r->param, sizeof(Count));
+		getInfo(r, &r->nbytes, sizeof(BigCount));
+		r->dictattrs = r->intattrs = 0;
+		if (version >= 3) getInfo(r, &r->dictattrs, sizeof(Bits));
+		if (version >= 4) getInfo(r, &r->intattrs, sizeof(Bits));
+	}
+	if (!validPageSize(r->pagesize)) fatal("Bad page size in relation info");
+	// ... before version 5, every page in the ovflow file counts
+	if (version >= 5) getInfo(r, &r->novpages, sizeof(Count));
+	else r->novpages = filePages(r->ovflow, r->pagesize);
+	return version;
+}
+
+// write the header of a relation to rel.info, in the latest version
+
+static void saveInfo(Reln r)
+{
+	Count magic = INFO_MAGIC, version = INFO_VERSION;
+	fseek(r->info, 0, SEEK_SET);
+	putInfo(r, &magic, sizeof(Count));
+	putInfo(r, &version, sizeof(Count));
+	// core relation info (#attrs,d,sp,#pages,#tuples)
+	putInfo(r, &r->nattrs, sizeof(Count));
+	putInfo(r, &r->depth, sizeof(Count));
+	putInfo(r, &r->sp, sizeof(Offset));
+	putInfo(r, &r->npages, sizeof(Count));
+	putInfo(r, &r->ntups, sizeof(BigCount));
+	// choice vector, and the layout and size of pages
+	putInfo(r, r->cv, MAXCHVEC*sizeof(ChVecItem));
+	putInfo(r, &r->format, sizeof(PageFormat));
+	putInfo(r, &r->pagesize, sizeof(Count));
+	// head of overflow free list, vacuum position
+	putInfo(r, &r->freeovf, sizeof(PageID));
+	putInfo(r, &r->vacpos, sizeof(PageID));
+	// split policy, and space used for load factor
+	putInfo(r, &r->policy, sizeof(Count));
+	putInfo(r, &r->param, sizeof(Count));
+	putInfo(r, &r->nbytes, sizeof(BigCount));
+	// attributes stored as dictionary codes
+	putInfo(r, &r->dictattrs, sizeof(Bits));
+	// ... and as ints
+	putInfo(r, &r->intattrs, sizeof(Bits));
+	// overflow pages
+	putInfo(r, &r->novpages, sizeof(Count));
+	fflush(r->info);
+}
+
 // set up a relation descriptor from relation name
 // open files, reads information from rel.info
+// a relation left with a log to replay can only be opened for
+//   writing, since replay updates its files
 
 Reln openRelation(char *name, char *mode)
 {
+	if (walPending(name)) {
+		if (mode[0] != 'w' && mode[1] != '+') {
+			char err[MAXERRMSG+MAXRELNAME];
+			sprintf(err, "Relation %s needs recovery; open it for writing "
+			        "(e.g. ./insert %s < /dev/null) to replay its log", name, name);
+			fatal(err);
+		}
+		recoverRelation(name);
+	}
 	Reln r;
 	r = malloc(sizeof(struct RelnRep));
 	assert(r != NULL);
@@ -83,12 +435,22 @@ Reln openRelation(char *name, char *mode)
 	sprintf(fname,"%s.ovflow",name);
 	r->ovflow = fopen(fname,mode);
 	assert(r->ovflow != NULL);
-	// Naughty: assumes Count and Offset are the same size
-	int n = fread(r, sizeof(Count), 5, r->info);
-	assert(n == 5);
-	n = fread(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
-	assert(n == MAXCHVEC);
+	Count version = loadInfo(r);
 	r->mode = (mode[0] == 'w' || mode[1] =='+') ? 'w' : 'r';
+	if (version < INFO_VERSION && r->mode == 'w') saveInfo(r);
+	r->dict = (r->dictattrs != 0) ? openDict(name, r->dictattrs, r->mode) : NULL;
+	r->plan = compileChVec(r->cv);
+	r->pool = newBufPool(NBUFS, r->pagesize);
+	r->tails = NULL;
+	r->nsegs = 0;
+	initRuntime(r, name);
+	// read-only scans take pages straight from the mapped files
+	if (r->mode == 'r') {
+		mapPoolFile(r->pool, r->data);
+		mapPoolFile(r->pool, r->ovflow);
+	}
+	else
+		loadBuckets(r, name);
 	return r;
 }
 
@@ -97,223 +459,1147 @@ Reln openRelation(char *name, char *mode)
 
 void closeRelation(Reln r)
 {
+	// pay off any split debt before the state is saved
+	backgroundSplits(r, FALSE);
+	// everything logged goes to the data files
+	if (r->wal != NULL) {
+		commit(r, TRUE);
+		setPoolWAL(r->pool, NULL);
+		closeWAL(r->wal);
+	}
 	// make sure updated global data is put in info
-	// Naughty: assumes Count and Offset are the same size
 	if (r->mode == 'w') {
-		fseek(r->info, 0, SEEK_SET);
-		// write out core relation info (#attr,#pages,d,sp)
-		int n = fwrite(r, sizeof(Count), 5, r->info);
-		assert(n == 5);
-		// write out choice vector
-		n = fwrite(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
-		assert(n == MAXCHVEC);
+		saveInfo(r);
+		// write out per-bucket chain hints
+		fseek(r->tails, 0, SEEK_SET);
+		for (PageID b = 0; b < r->npages; b++) {
+			int n = fwrite(hint(r, b), sizeof(BucketInfo), 1, r->tails);
+			assert(n == 1);
+		}
+		fclose(r->tails);
 	}
+	freeBuckets(r);
+	// write back any dirty pages before closing files
+	freeBufPool(r->pool);
+	freeChVecPlan(r->plan);
+	if (r->dict != NULL) closeDict(r->dict);
 	fclose(r->info);
 	fclose(r->data);
 	fclose(r->ovflow);
+	pthread_mutex_destroy(&r->lock);
+	pthread_mutex_destroy(&r->splitlock);
+	pthread_mutex_destroy(&r->ovlock);
+	pthread_cond_destroy(&r->owed);
+	pthread_cond_destroy(&r->idle);
+	pthread_cond_destroy(&r->resume);
+	free(r->name);
 	free(r);
 }
 
+// map a tuple hash to its bucket using the current depth/sp
+// buckets before the split pointer have already been split,
+//   so they are addressed with one more hash bit
+
+static PageID bucketOf(Reln r, Bits h)
+{
+	if (r->depth == 0) return 0;
+	PageID p = getLower(h, r->depth);
+	if (p < r->sp) p = getLower(h, r->depth+1);
+	return p;
+}
+
+// split policies (see reln.h)
+// - SPLIT_EVERY: split after every param insertions
+// - SPLIT_LOAD: split when the tuples would fill more than param%
+//   of the primary pages, going by the space they really take
+// - SPLIT_CHAIN: split when an insertion leaves a bucket with more
+//   than param overflow pages
+// the first two are decided before each insertion, from the size
+//   of the relation, so a batch can work out all of its splits
+//   up front; the last depends on where the tuple goes
+
+// the usual setting for a policy
+// for SPLIT_EVERY, a rough estimate of how many tuples fit in a
+//   page of pagesize bytes: about 10 bytes a value, plus what the
+//   format spends on each tuple's slot and on the page signature
+
+Count defaultSplitParam(Count policy, Count nattrs, PageFormat format, Count pagesize)
+{
+	Count sig = pageCapacity(PACKED_PAGES, pagesize) - pageCapacity(format, pagesize);
+	switch (policy) {
+	case SPLIT_LOAD:  return 75;
+	case SPLIT_CHAIN: return 1;
+	default:          return (pagesize - sig)/(10*nattrs + slotSpace(format));
+	}
+}
+
+// would a relation of npages buckets need a split before it
+//   grows to ntups tuples taking nbytes?
+
+static Bool splitDue(Reln r, BigCount ntups, BigCount nbytes, Count npages)
+{
+	switch (r->policy) {
+	case SPLIT_EVERY:
+		return ntups % r->param == 0;
+	case SPLIT_LOAD:
+		return (double)nbytes*100 > (double)r->param*npages*pageCapacity(r->format, r->pagesize);
+	default:
+		return FALSE;
+	}
+}
+
+// advance the split pointer after a bucket has been split
+
+static void advanceSplit(Reln r)
+{
+	if (r->sp + 1 < (1 << r->depth))
+		r->sp++; //move split pointer
+	else {
+		r->depth++;
+		r->sp = 0; //reset split pointer
+	}
+}
+
+// note that a split is due; whoever pays off the debt does it
+// caller holds lock
+
+static void owe(Reln r)
+{
+	r->debt++;
+	if (r->bgsplit) pthread_cond_signal(&r->owed);
+}
+
+// with background splitting on, the splitter thread pays off split
+//   debt; otherwise each inserter pays off all of it before going on
+// if the splitter falls more than MAXDEBT splits behind, inserters
+//   help it out, a step for each tuple added, so that chains can't
+//   grow unchecked
+// the mode is only changed while no one else is using the relation
+
+#define MAXDEBT 4
+
+static void payOwed(Reln r, Count ntups)
+{
+	if (!r->bgsplit) {
+		payDebt(r, TRUE);
+		return;
+	}
+	for (Count i = 0; i < ntups; i++) {
+		pthread_mutex_lock(&r->lock);
+		Bool behind = r->debt > MAXDEBT;
+		pthread_mutex_unlock(&r->lock);
+		if (!behind) return;
+		payDebt(r, FALSE);
+	}
+}
+
+// latch bucket b if it is still the bucket for hash h
+// a bucket only stops being the one for h when it is split, and
+//   the split holds the bucket's latch, so once latched, a bucket
+//   that still matches h stays right until the latch is released
+// *routed says whether a split of the bucket is under way
+
+static Bool latchIfCurrent(Reln r, PageID b, Bits h, Bool *routed)
+{
+	pthread_mutex_lock(latch(r, b));
+	pthread_mutex_lock(&r->lock);
+	Bool ok = bucketOf(r, h) == b;
+	*routed = r->split.active && r->split.old == b;
+	pthread_mutex_unlock(&r->lock);
+	if (!ok) pthread_mutex_unlock(latch(r, b));
+	return ok;
+}
+
+// find and latch the bucket for hash h
+
+static PageID latchBucket(Reln r, Bits h, Bool *routed)
+{
+	for (;;) {
+		pthread_mutex_lock(&r->lock);
+		PageID b = bucketOf(r, h);
+		pthread_mutex_unlock(&r->lock);
+		if (latchIfCurrent(r, b, h, routed)) return b;
+	}
+}
+
+// put a tuple into latched bucket p; if p is being split, the tuple
+//   goes straight into the new chain it belongs in
+// returns the bucket that now holds it, or NO_PAGE if that fails
+
+static PageID insertRouted(Reln r, Tuple t, Bits h, PageID p, Bool routed)
+{
+	if (!routed) return insertIntoPage(r, t, h, p);
+	SplitState *s = &r->split;
+	int hi = bitIsSet(h, r->depth);
+	addToChain(r, &s->out[hi], t, h);
+	return hi ? s->buddy : s->old;
+}
+
+// the stored form of text tuple t, with ints in binary and
+//   dictionary attributes as codes: t itself if it is stored as
+//   it is, otherwise a new tuple; NULL if an int isn't an int
+
+static Tuple storedTuple(Reln r, Tuple t)
+{
+	Tuple st = t;
+	if (r->intattrs != 0 && (st = packTuple(r, t, FALSE)) == NULL) return NULL;
+	if (r->dict != NULL) {
+		Tuple enc = encodeTuple(r->dict, st, TRUE);
+		if (st != t) free(st);
+		st = enc;
+	}
+	return st;
+}
+
 // insert a new tuple into a relation
 // returns index of bucket where inserted
 // - index always refers to a primary data page
 // - the actual insertion page may be either a data page or an overflow page
 // returns NO_PAGE if insert fails completely
-// TODO: include splitting and file expansion
+// the tuple is given in text form, and stored as storedTuple() says
+// any number of threads may add tuples at once; each holds only the
+//   latch of the bucket it is adding to
 
 PageID addToRelation(Reln r, Tuple t)
 {
-	int nTuples = r->ntups + 1; //add one tuple count for the new incoming tuple
-	int nAttributes = r->nattrs; //read in attribute count
+	Tuple given = t;
+	if ((t = storedTuple(r, given)) == NULL) return NO_PAGE;
+	Bits h = tupleHash(r,t); //get the hash of the incoming tuple
+	Count space = tupleSpace(t, r->format);
+	beginUpdate(r);
 
-	int pageCapacity = PAGESIZE/(10*nAttributes); //calculate page tuple capacity
+	//count the tuple in, and see whether that calls for a split
+	pthread_mutex_lock(&r->lock);
+	r->ntups++;
+	r->nbytes += space;
+	if (splitDue(r, r->ntups, r->nbytes, r->npages)) //split needed
+		owe(r);
+	Bool owing = r->debt > 0;
+	pthread_mutex_unlock(&r->lock);
+	if (owing) payOwed(r, 1);
 
-	if (nTuples % pageCapacity == 0) //split needed
-		splitRelation(r);
+	Bool routed;
+	PageID p = latchBucket(r, h, &routed); //find correct page to insert
+	PageID b = insertRouted(r, t, h, p, routed);
+	Bool toolong = b != NO_PAGE && !routed &&
+	               r->policy == SPLIT_CHAIN && hint(r, p)->nov > r->param;
+	pthread_mutex_unlock(latch(r, p));
 
-	Bits h, p; //hash and page bits
-	char buf[MAXBITS+1];
-	char tupleBuf[MAXTUPLEN+1];
-	h = tupleHash(r,t); //get the hash of the incoming tuple
-	//find correct page to insert
-	if (r->depth == 0)
-		p = 1;
-	else {
-		p = getLower(h, r->depth);
-		if (p < r->sp) p = getLower(h, r->depth+1);
-	}
-	tupleString(t, tupleBuf);
-	bitsString(h,buf); printf("hash(%s) = %s\n",tupleBuf, buf);
-//	bitsString(p,buf); printf("page = %s\n",buf);
-	Page pg = getPage(r->data,p);
-	if (addToPage(pg,t) == OK) {
-		putPage(r->data,p,pg);
-		r->ntups++;
-		return p;
-	}
-	// primary data page full
-	if (pageOvflow(pg) == NO_PAGE) {
-		// add first overflow page in chain
-		PageID newp = addPage(r->ovflow);
-		pageSetOvflow(pg,newp);
-		putPage(r->data,p,pg);
-		Page newpg = getPage(r->ovflow,newp);
-		// can't add to a new page; we have a problem
-		if (addToPage(newpg,t) != OK) return NO_PAGE;
-		putPage(r->ovflow,newp,newpg);
-		r->ntups++;
-		return p;
+	if (b == NO_PAGE || toolong) {
+		pthread_mutex_lock(&r->lock);
+		if (b == NO_PAGE) {
+			r->ntups--;
+			r->nbytes -= space;
+		}
+		else
+			owe(r);
+		pthread_mutex_unlock(&r->lock);
+		if (toolong) payOwed(r, 1);
+	}
+	endUpdate(r);
+	maybeCommit(r);
+	if (t != given) free(t);
+	return b;
+}
+
+// overflow pages emptied by splits are kept on a free list,
+//   linked through their ovflow fields, and reused before
+//   the ovflow file is made any bigger
+// the head of the list is saved in rel.info
+
+// take a blank overflow page from the free list, or add one
+
+static PageID newOvflowPage(Reln r)
+{
+	pthread_mutex_lock(&r->ovlock);
+	PageID pid = r->freeovf;
+	if (pid == NO_PAGE) {
+		pid = addPage(r->ovflow, r->pagesize);
+		r->novpages = pid + 1;
 	}
 	else {
-		// scan overflow chain until we find space
-		// worst case: add new ovflow page at end of chain
-		Page ovpg, prevpg = NULL;
-		PageID ovp, prevp = NO_PAGE;
-		ovp = pageOvflow(pg);
-		while (ovp != NO_PAGE) {
-			ovpg = getPage(r->ovflow, ovp);
-			if (addToPage(ovpg,t) != OK) {
-				prevp = ovp; prevpg = ovpg;
-				ovp = pageOvflow(ovpg);
-			}
-			else {
-				if (prevpg != NULL) free(prevpg);
-				putPage(r->ovflow,ovp,ovpg);
-				r->ntups++;
-				return p;
+		Page p = pinPage(r->pool, r->ovflow, pid);
+		r->freeovf = pageOvflow(p);
+		initPage(p, r->pagesize);
+		unpinPage(r->pool, p, TRUE);
+	}
+	pthread_mutex_unlock(&r->ovlock);
+	return pid;
+}
+
+// put a pinned overflow page, no longer in any chain, on the free list
+
+static void freeOvflowPage(Reln r, Page p, PageID pid)
+{
+	pthread_mutex_lock(&r->ovlock);
+	initPage(p, r->pagesize);
+	pageSetOvflow(p, r->freeovf);
+	r->freeovf = pid;
+	unpinPage(r->pool, p, TRUE);
+	pthread_mutex_unlock(&r->ovlock);
+}
+
+static void writeChainPage(Reln r, ChainOut *c)
+{
+	Page p = pinPage(r->pool, c->f, c->pid);
+	memcpy(p, c->buf, r->pagesize);
+	unpinPage(r->pool, p, TRUE);
+}
+
+static void addToChain(Reln r, ChainOut *c, Tuple t, Bits h)
+{
+	if (addToPage(c->buf, t, h, r->format, r->pagesize) == OK) return;
+	PageID next = newOvflowPage(r);
+	pageSetOvflow(c->buf, next);
+	writeChainPage(r, c);
+	c->f = r->ovflow;
+	c->pid = c->tail = next;
+	c->nov++;
+	initPage(c->buf, r->pagesize);
+	if (addToPage(c->buf, t, h, r->format, r->pagesize) != OK)
+		fatal("tuple insertion during split failed");
+}
+
+// split the bucket at the split pointer
+// the old chain is read once, a page at a time; each tuple goes
+//   into one of two new chains, for the old and new buckets,
+//   decided by bit depth of its hash (the lower depth bits are
+//   the same for every tuple in the bucket)
+// the new chains reuse the old bucket's primary page and its
+//   overflow pages (via the free list) once they have been read,
+//   so the split costs time linear in the size of the bucket and
+//   only adds pages to the ovflow file if the new chains need more
+// a split is done in steps of one old page (splitStep()), so the
+//   splitter thread never holds up inserts for long; while it is
+//   under way, depth and sp are unchanged, and tuples for the old
+//   bucket are added straight to the new chains (insertRouted())
+// only one split is done at a time (under splitlock); each step
+//   latches just the old bucket and its new buddy, and sp and depth
+//   move on, under lock, while both are still latched
+
+// set up the state that only lasts while a relation is open
+
+static void initRuntime(Reln r, char *name)
+{
+	r->split.active = FALSE;
+	r->debt = 0;
+	r->bgsplit = FALSE;
+	r->stopping = FALSE;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_mutex_init(&r->splitlock, NULL);
+	pthread_mutex_init(&r->ovlock, NULL);
+	pthread_cond_init(&r->owed, NULL);
+	r->name = copyString(name);
+	r->wal = NULL;
+	r->interval = 0;
+	r->lastcommit = 0;
+	r->committing = r->pausing = FALSE;
+	r->nupdating = 0;
+	pthread_cond_init(&r->idle, NULL);
+	pthread_cond_init(&r->resume, NULL);
+}
+
+// add the new bucket and set up the chains for a split
+// caller holds splitlock and lock
+
+static void startSplit(Reln r)
+{
+	SplitState *s = &r->split;
+	assert(!s->active);
+	s->old = r->sp;
+	s->buddy = addPage(r->data, r->pagesize);
+	r->npages++;
+	growBuckets(r);
+
+	s->out[0].pid = s->old; s->out[1].pid = s->buddy;
+	for (int i = 0; i < 2; i++) {
+		s->out[i].f = r->data;
+		s->out[i].tail = NO_PAGE;
+		s->out[i].nov = 0;
+		s->out[i].buf = newPage(r->pagesize);
+	}
+	s->f = r->data;
+	s->next = s->old;
+	s->active = TRUE;
+}
+
+// write the last page of each chain, note where the chains end
+//   and move the split pointer on
+// caller holds splitlock and the latches of both buckets
+
+static void finishSplit(Reln r)
+{
+	SplitState *s = &r->split;
+	PageID bucket[2] = { s->old, s->buddy };
+	for (int i = 0; i < 2; i++) {
+		ChainOut *c = &s->out[i];
+		writeChainPage(r, c);
+		BucketInfo *bk = hint(r, bucket[i]);
+		bk->tail = c->tail;
+		bk->nov = c->nov;
+		bk->free = pageFreeSpace(c->buf, r->format, r->pagesize);
+		free(c->buf);
+	}
+	pthread_mutex_lock(&r->lock);
+	s->active = FALSE;
+	advanceSplit(r);
+	pthread_mutex_unlock(&r->lock);
+}
+
+// move the tuples of the next page of the old chain
+// caller holds splitlock
+
+static void splitStep(Reln r)
+{
+	SplitState *s = &r->split;
+	assert(s->active);
+	pthread_mutex_lock(latch(r, s->old));
+	pthread_mutex_lock(latch(r, s->buddy));
+	if (s->next != NO_PAGE) {
+		Page page = pinPage(r->pool, s->f, s->next);
+		char *c = pageData(page);
+		for (Count k = 0; k < pageNTuples(page); k++) {
+			Tuple t = c;
+			if (r->format >= SLOTTED_PAGES) //slots give each tuple directly
+				t = pageTuple(page, k, r->format, r->pagesize);
+			else
+				c += strlen(c) + 1; //skip the '\0' after each tuple
+			Bits h = (r->format >= HASHED_PAGES) ? pageTupleHash(page, k, r->format, r->pagesize)
+			                                     : tupleHash(r, t);
+			addToChain(r, &s->out[bitIsSet(h, r->depth)], t, h);
+		}
+		PageID next = pageOvflow(page);
+		if (s->f == r->data)
+			unpinPage(r->pool, page, FALSE); //rewritten by out[0] at the end
+		else
+			freeOvflowPage(r, page, s->next);
+		s->f = r->ovflow;
+		s->next = next;
+	}
+	PageID old = s->old, buddy = s->buddy;
+	if (s->next == NO_PAGE) finishSplit(r);
+	pthread_mutex_unlock(latch(r, buddy));
+	pthread_mutex_unlock(latch(r, old));
+}
+
+// do one step of the split under way, or of the next one owed;
+//   with all, carry on until no splits are owed
+// caller must hold no latches
+
+static void payDebt(Reln r, Bool all)
+{
+	pthread_mutex_lock(&r->splitlock);
+	do {
+		pthread_mutex_lock(&r->lock);
+		if (!r->split.active) {
+			if (r->debt == 0) {
+				pthread_mutex_unlock(&r->lock);
+				break;
 			}
+			r->debt--;
+			startSplit(r);
 		}
-		// all overflow pages are full; add another to chain
-		// at this point, there *must* be a prevpg
-		assert(prevpg != NULL);
-		// make new ovflow page
-		PageID newp = addPage(r->ovflow);
-		// insert tuple into new page
-		Page newpg = getPage(r->ovflow,newp);
-	        if (addToPage(newpg,t) != OK) return NO_PAGE;
-        	putPage(r->ovflow,newp,newpg);
-		// link to existing overflow chain
-		pageSetOvflow(prevpg,newp);
-		putPage(r->ovflow,prevp,prevpg);
-        	r->ntups++;
-		return p;
-	}
-	return NO_PAGE;
-}
-
-void splitRelation(Reln r) {
-	//add a new page
-	addPage(r->data);
-	r->npages++;
+		pthread_mutex_unlock(&r->lock);
+		splitStep(r);
+	} while (all);
+	pthread_mutex_unlock(&r->splitlock);
+}
 
-	PageID pid = r->sp;
-	FILE * f = r->data;
-	Offset currTupleOffset = 0;
-	Count nTuples = 0;
+// split a bucket now, after paying off any split debt
 
-	//space for store tuples that should be in original page
-	Tuple * origin = malloc(PAGESIZE * sizeof(Tuple));
-	int i = 0;
+void splitRelation(Reln r)
+{
+	pthread_mutex_lock(&r->lock);
+	owe(r);
+	pthread_mutex_unlock(&r->lock);
+	payDebt(r, TRUE);
+}
 
-	while (pid != NO_PAGE) {
-		Page page = getPage(f, pid);
-		if(pageNTuples(page) == 0) break; //no tuple in the page, break
-
-		Tuple t = nextTuple(f, pid, currTupleOffset); //get current tuple
-
-		// hash the current tuple and check its new pageID
-		Bits hash = tupleHash(r, t);
-		Bits newID = getLower(hash, r->depth + 1); //remember to add 1 for correct depth
-
-		if (newID == pid) //if the tuple should remain at the original page
-			origin[i++] = copyString(t);
-		else // the tuple will be insert into new page
-			if (insertIntoPage(r, t, newID) == NO_PAGE)
-				fatal("tuple insertion to new page failed");
-		currTupleOffset += strlen(t) + 1; //add '\0' position for the tuple, since it is simply a string
-		nTuples ++; //add tuple count
-
-		if (nTuples >= pageNTuples(page)) {//if there are tuples more than one page
-			//add another page and change to overflow
-			Page newpage = newPage();
-			putPage(f, pid, newpage);
-			pid = pageOvflow(page); //get overflow page id
-			nTuples = 0; //reset tuple count
-			currTupleOffset = 0; //reset tuple overflow
-			f = r->ovflow; //point to overflow position
+// the splitter thread: pays off split debt a step at a time,
+//   letting inserters have the relation between steps
+
+static void *splitter(void *arg)
+{
+	Reln r = arg;
+	pthread_mutex_lock(&r->lock);
+	for (;;) {
+		if (!r->split.active && r->debt == 0) {
+			if (r->stopping) break;
+			pthread_cond_wait(&r->owed, &r->lock);
+			continue;
 		}
-		free(t); //free original tuple, they are already in origin storage
+		pthread_mutex_unlock(&r->lock);
+		beginUpdate(r);
+		payDebt(r, FALSE);
+		endUpdate(r);
+		sched_yield();
+		pthread_mutex_lock(&r->lock);
 	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
 
-	for (int j = 0; j < i; j++) { //put original page tuples into original
-		Tuple temp = origin[j];
-		if (insertIntoPage(r, temp, r->sp) == NO_PAGE) //insert into splitter page
-			fatal("tuple insertion to original page failed");
-		free(temp);//free out tuple
+// turn background splitting on or off
+// turning it off waits for the splitter to pay off all split debt
+
+void backgroundSplits(Reln r, Bool on)
+{
+	if (on == r->bgsplit) return;
+	if (on) {
+		assert(r->mode == 'w');
+		r->stopping = FALSE;
+		r->bgsplit = TRUE;
+		if (pthread_create(&r->splitter, NULL, splitter, r) != 0)
+			fatal("Can't start splitter thread");
+		return;
 	}
+	pthread_mutex_lock(&r->lock);
+	r->stopping = TRUE;
+	pthread_cond_signal(&r->owed);
+	pthread_mutex_unlock(&r->lock);
+	pthread_join(r->splitter, NULL);
+	r->bgsplit = FALSE;
+}
 
-	free(origin); //free the whole temp storage
-	if (getLower(r->sp + 1, r->depth) != 0)
-		r->sp++; //move split pointer
-	else {
-		r->depth++;
-		r->sp = 0; //reset split pointer
+// splits due but not yet finished (including one under way)
+
+Count splitsOwed(Reln r)
+{
+	pthread_mutex_lock(&r->lock);
+	Count n = r->debt + (r->split.active ? 1 : 0);
+	pthread_mutex_unlock(&r->lock);
+	return n;
+}
+
+// write-ahead logging (see wal.c)
+// while a relation is logged, its data files only ever hold the
+//   state of the last checkpoint; updates since then are in the
+//   log, and a commit every interval ms makes them durable
+// a commit waits for the updates under way to finish (holding off
+//   new ones), and for any split under way, so that the pages and
+//   header it logs agree with each other; commits happen at the
+//   end of an update, so no one waits long for one
+// the log is checkpointed when it holds more than MAXWAL pages'
+//   worth, and when the relation is closed
+
+#define MAXWAL 4096
+
+// bracket a change to a logged relation
+
+static void beginUpdate(Reln r)
+{
+	if (r->wal == NULL) return;
+	pthread_mutex_lock(&r->lock);
+	while (r->pausing) pthread_cond_wait(&r->resume, &r->lock);
+	r->nupdating++;
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void endUpdate(Reln r)
+{
+	if (r->wal == NULL) return;
+	pthread_mutex_lock(&r->lock);
+	if (--r->nupdating == 0 && r->pausing) pthread_cond_signal(&r->idle);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void takeSnapshot(Reln r, Snapshot *s)
+{
+	s->ntups = r->ntups; s->depth = r->depth; s->sp = r->sp;
+	s->npages = r->npages; s->nbytes = r->nbytes; s->novpages = r->novpages;
+	s->freeovf = r->freeovf; s->vacpos = r->vacpos;
+}
+
+static void useSnapshot(Reln r, Snapshot *s)
+{
+	r->ntups = s->ntups; r->depth = s->depth; r->sp = s->sp;
+	r->npages = s->npages; r->nbytes = s->nbytes; r->novpages = s->novpages;
+	r->freeovf = s->freeovf; r->vacpos = s->vacpos;
+}
+
+static void syncInfo(Reln r)
+{
+	saveInfo(r);
+	if (fsync(fileno(r->info)) != 0) fatal("Can't sync relation");
+}
+
+// commit the updates so far, and maybe checkpoint the log
+// caller must not be in the middle of an update
+
+static void commit(Reln r, Bool checkpoint)
+{
+	pthread_mutex_lock(&r->lock);
+	r->pausing = TRUE;
+	while (r->nupdating > 0) pthread_cond_wait(&r->idle, &r->lock);
+	pthread_mutex_unlock(&r->lock);
+
+	pthread_mutex_lock(&r->splitlock);
+	while (r->split.active) splitStep(r);
+	pthread_mutex_unlock(&r->splitlock);
+	flushBufPool(r->pool); //dirty pages go to the log
+	Snapshot s;
+	takeSnapshot(r, &s);
+	//values the logged tuples are encoded with must outlast them
+	if (r->dict != NULL) syncDict(r->dict);
+	logCommit(r->wal, &s, sizeof s);
+	if (checkpoint) {
+		syncWAL(r->wal);
+		applyWAL(r->wal);
+		syncInfo(r);
+		resetWAL(r->wal);
+	}
+
+	pthread_mutex_lock(&r->lock);
+	r->pausing = FALSE;
+	pthread_cond_broadcast(&r->resume);
+	pthread_mutex_unlock(&r->lock);
+	if (!checkpoint) syncWAL(r->wal);
+}
+
+// commit if the interval is up and no one else is committing
+
+static void maybeCommit(Reln r)
+{
+	if (r->wal == NULL) return;
+	pthread_mutex_lock(&r->lock);
+	Bool due = !r->committing && (now() - r->lastcommit)*1000 >= r->interval;
+	if (due) r->committing = TRUE;
+	pthread_mutex_unlock(&r->lock);
+	if (!due) return;
+	commit(r, walSize(r->wal) > (off_t)MAXWAL*r->pagesize);
+	pthread_mutex_lock(&r->lock);
+	r->committing = FALSE;
+	r->lastcommit = now();
+	pthread_mutex_unlock(&r->lock);
+}
+
+// log updates to a relation from now on, committing them every
+//   interval ms (0 to commit each update)
+// the relation must not be in use by other threads
+
+void logRelation(Reln r, Count interval)
+{
+	assert(r->mode == 'w' && r->wal == NULL && !r->bgsplit);
+	//start from a state that is on disk
+	flushBufPool(r->pool);
+	fflush(r->data); fflush(r->ovflow);
+	if (fsync(fileno(r->data)) != 0 || fsync(fileno(r->ovflow)) != 0)
+		fatal("Can't sync relation");
+	syncInfo(r);
+	if (r->dict != NULL) syncDict(r->dict);
+	r->wal = openWAL(r->name, r->data, r->ovflow, r->pagesize);
+	resetWAL(r->wal);
+	setPoolWAL(r->pool, r->wal);
+	r->interval = interval;
+	r->lastcommit = now();
+}
+
+// make all updates so far durable
+
+void commitRelation(Reln r)
+{
+	if (r->wal != NULL) commit(r, FALSE);
+}
+
+// bring a relation's files up to date from its log, after a crash
+// the data files get the pages of every committed group, rel.info
+//   gets the header of the last one, and pages added since then are
+//   cut off the data and ovflow files; the chain hints are rebuilt
+//   on opening
+
+static void recoverRelation(char *name)
+{
+	char fname[MAXFILENAME];
+	struct RelnRep *r = malloc(sizeof(struct RelnRep));
+	assert(r != NULL);
+	sprintf(fname,"%s.info",name);
+	r->info = fopen(fname,"r+");
+	sprintf(fname,"%s.data",name);
+	r->data = fopen(fname,"r+");
+	sprintf(fname,"%s.ovflow",name);
+	r->ovflow = fopen(fname,"r+");
+	if (r->info == NULL || r->data == NULL || r->ovflow == NULL)
+		fatal("Can't open relation for recovery");
+	loadInfo(r);
+	WAL w = openWAL(name, r->data, r->ovflow, r->pagesize);
+	Snapshot s;
+	if (replayWAL(w, &s, sizeof s)) {
+		useSnapshot(r, &s);
+		syncInfo(r);
 	}
+	if (ftruncate(fileno(r->data), pageOffset(r->npages, r->pagesize)) != 0)
+		fatal("Can't truncate data file");
+	if (ftruncate(fileno(r->ovflow), pageOffset(r->novpages, r->pagesize)) != 0)
+		fatal("Can't truncate overflow file");
+	resetWAL(w);
+	closeWAL(w);
+	sprintf(fname,"%s.tails",name);
+	remove(fname);
+	fclose(r->info);
+	fclose(r->data);
+	fclose(r->ovflow);
+	free(r);
 }
 
 //insert to specific page helper function, modified from insert into relation
-PageID insertIntoPage(Reln r, Tuple t, PageID pid) {
-	Page page = getPage(r->data, pid);
-
-	if (addToPage(page, t) == OK) {
-		putPage(r->data, pid, page);
-		return pid;
-	}
-	if(pageOvflow(page) == NO_PAGE) { //full of tuple, need overflow page
-		PageID newPid = addPage(r->ovflow);
-		pageSetOvflow(page, newPid); //need overflow page
-		putPage(r->data, pid, page); //put the page in
-		Page newPage = getPage(r->ovflow, newPid); //get overflow page
-		if (addToPage(newPage, t) != OK) return NO_PAGE; //add error, return NO_PAGE
-		putPage(r->ovflow, newPid, newPage); //insert into overflow page position
-		return pid;
-	} else { //have overflow page, go through until find a space to insert
-		Page overflowPage, prevPage = NULL;
-		PageID overflowPid, prevPid = NO_PAGE;
-		overflowPid = pageOvflow(page);
-		while( overflowPid != NO_PAGE ) { //traval through overflow page chain
-			overflowPage = getPage(r->ovflow, overflowPid);
-			if(addToPage(overflowPage, t) != OK) { //full, try next page
-				prevPage = overflowPage; //update prev for record
-				prevPid = overflowPid;
-				overflowPid = pageOvflow(overflowPage); //get next overflow page
-			} else { //have space, insert
-				if (prevPage != NULL) free(prevPage); //free previous page
-				putPage(r->ovflow, overflowPid, overflowPage); //add page into file
-				return pid;
+//pages are pinned in the buffer pool; only modified pages are marked dirty
+//h is the tuple's composite hash, kept with it in hashed pages
+//caller holds the bucket's latch (or has the relation to itself)
+PageID insertIntoPage(Reln r, Tuple t, Bits h, PageID pid) {
+	return insertManyIntoPage(r, &t, &h, 1, pid);
+}
+
+//insert a group of tuples that all belong to bucket pid
+//the bucket's tail hint means the middle of the chain is never read:
+//  tuples go in the last page of the chain (the primary page
+//  if there is no chain) and then in new pages added after it
+PageID insertManyIntoPage(Reln r, Tuple *ts, Bits *hs, Count n, PageID pid) {
+	BucketInfo *bk = hint(r, pid);
+	Page page = (bk->tail == NO_PAGE) ? pinPage(r->pool, r->data, pid)
+	                                  : pinPage(r->pool, r->ovflow, bk->tail);
+	Bool dirty = FALSE;
+
+	for (Count i = 0; i < n; i++) {
+		//hint says whether it is worth trying the tail page
+		if (tupLength(ts[i]) < bk->free && addToPage(page, ts[i], hs[i], r->format, r->pagesize) == OK) {
+			bk->free = pageFreeSpace(page, r->format, r->pagesize);
+			dirty = TRUE;
+			continue;
+		}
+		//end of chain is full, add a new overflow page
+		PageID newPid = newOvflowPage(r);
+		pageSetOvflow(page, newPid); //link the overflow chain
+		unpinPage(r->pool, page, TRUE);
+		page = pinPage(r->pool, r->ovflow, newPid);
+		bk->tail = newPid;
+		bk->nov++;
+		if (addToPage(page, ts[i], hs[i], r->format, r->pagesize) != OK) {
+			//can't add to an empty page; we have a problem
+			bk->free = pageFreeSpace(page, r->format, r->pagesize);
+			unpinPage(r->pool, page, FALSE);
+			return NO_PAGE;
+		}
+		bk->free = pageFreeSpace(page, r->format, r->pagesize);
+		dirty = TRUE;
+	}
+	unpinPage(r->pool, page, dirty);
+	return pid;
+}
+
+//insert a batch of tuples
+//any splits the batch would trigger are done first, so that
+//  each tuple is hashed once and goes straight to its final bucket;
+//  the batch is then grouped by bucket and each group is added
+//  with a single walk of its chain
+//with background splitting, the splits are only owed, and tuples
+//  go to the buckets they belong in now
+//a group whose bucket is split by another thread before it can be
+//  latched is added a tuple at a time
+//returns OK, or ~OK if some tuple could not be inserted
+
+typedef struct { PageID bucket; Count idx; } BatchItem;
+
+static int cmpBatchItem(const void *a, const void *b)
+{
+	const BatchItem *x = a, *y = b;
+	if (x->bucket != y->bucket) return (x->bucket < y->bucket) ? -1 : 1;
+	return (x->idx < y->idx) ? -1 : (x->idx > y->idx);
+}
+
+// the stored forms of a batch of tuples: ts itself if they are
+//   stored as they are, NULL if any of them can't be stored
+
+static Tuple *storedBatch(Reln r, Tuple *ts, Count n)
+{
+	if (r->intattrs == 0 && r->dict == NULL) return ts;
+	Tuple *st = malloc(n * sizeof(Tuple));
+	assert(st != NULL);
+	for (Count i = 0; i < n; i++) {
+		if ((st[i] = storedTuple(r, ts[i])) != NULL) continue;
+		while (i > 0) free(st[--i]);
+		free(st);
+		return NULL;
+	}
+	return st;
+}
+
+static void freeBatch(Tuple *st, Tuple *ts, Count n)
+{
+	if (st == ts) return;
+	for (Count i = 0; i < n; i++) free(st[i]);
+	free(st);
+}
+
+Status addManyToRelation(Reln r, Tuple *ts, Count n)
+{
+	if (n == 0) return OK;
+	if (r->policy == SPLIT_CHAIN) {
+		//splits depend on where each tuple lands; go one at a time
+		Status status = OK;
+		for (Count i = 0; i < n; i++)
+			if (addToRelation(r, ts[i]) == NO_PAGE) status = ~OK;
+		return status;
+	}
+	Tuple *given = ts;
+	if ((ts = storedBatch(r, given, n)) == NULL) return ~OK;
+	Bits *hash = malloc(n * sizeof(Bits));
+	BatchItem *items = malloc(n * sizeof(BatchItem));
+	Tuple *group = malloc(n * sizeof(Tuple));
+	Bits *ghash = malloc(n * sizeof(Bits));
+	assert(hash != NULL && items != NULL && group != NULL && ghash != NULL);
+	Count *space = malloc(n * sizeof(Count));
+	assert(space != NULL);
+	for (Count i = 0; i < n; i++) {
+		hash[i] = tupleHash(r, ts[i]);
+		space[i] = tupleSpace(ts[i], r->format);
+	}
+
+	//same splits, in the same order, as n calls of addToRelation()
+	beginUpdate(r);
+	pthread_mutex_lock(&r->lock);
+	for (Count i = 0; i < n; i++) {
+		r->ntups++;
+		r->nbytes += space[i];
+		if (splitDue(r, r->ntups, r->nbytes, r->npages))
+			owe(r);
+	}
+	Bool owing = r->debt > 0;
+	pthread_mutex_unlock(&r->lock);
+	if (owing && !r->bgsplit) payOwed(r, n);
+
+	pthread_mutex_lock(&r->lock);
+	for (Count i = 0; i < n; i++) {
+		items[i].bucket = bucketOf(r, hash[i]);
+		items[i].idx = i;
+	}
+	pthread_mutex_unlock(&r->lock);
+	qsort(items, n, sizeof(BatchItem), cmpBatchItem);
+
+	Status status = OK;
+	Count i = 0, nfailed = 0;
+	BigCount lost = 0;
+	while (i < n) {
+		PageID b = items[i].bucket;
+		Count ng = 0, gbytes = 0, first = i;
+		for (; i < n && items[i].bucket == b; i++) {
+			ghash[ng] = hash[items[i].idx];
+			gbytes += space[items[i].idx];
+			group[ng++] = ts[items[i].idx];
+		}
+		Bool routed;
+		if (!latchIfCurrent(r, b, ghash[0], &routed)) {
+			//bucket has been split meanwhile
+			for (Count k = 0; k < ng; k++) {
+				PageID p = latchBucket(r, ghash[k], &routed);
+				if (insertRouted(r, group[k], ghash[k], p, routed) == NO_PAGE) {
+					status = ~OK;
+					nfailed++;
+					lost += space[items[first+k].idx];
+				}
+				pthread_mutex_unlock(latch(r, p));
 			}
+			continue;
+		}
+		if (routed) {
+			//bucket is being split; each tuple goes to its half
+			for (Count k = 0; k < ng; k++) insertRouted(r, group[k], ghash[k], b, TRUE);
+		}
+		else if (insertManyIntoPage(r, group, ghash, ng, b) == NO_PAGE) {
+			status = ~OK;
+			nfailed += ng;
+			lost += gbytes;
 		}
-		//overflow chain is full, add a new overflow page
-		PageID newPid = addPage(r->ovflow); //add page
-		Page newPage = getPage(r->ovflow, newPid);
-		if (addToPage(newPage, t) != OK) return NO_PAGE;
-		putPage(r->ovflow, newPid, newPage); //put into overflow
-		pageSetOvflow(prevPage, newPid); //link the overflow chain
-		putPage(r->ovflow, prevPid, prevPage); //update the page
-		return pid;
+		pthread_mutex_unlock(latch(r, b));
 	}
-	return NO_PAGE; //fatal error, return NO_PAGE
+	if (nfailed > 0) {
+		pthread_mutex_lock(&r->lock);
+		r->ntups -= nfailed;
+		r->nbytes -= lost;
+		pthread_mutex_unlock(&r->lock);
+	}
+	if (owing && r->bgsplit) payOwed(r, n);
+	endUpdate(r);
+	maybeCommit(r);
+	free(hash); free(items); free(group); free(ghash); free(space);
+	freeBatch(ts, given, n);
+	return status;
 }
+
+// load a batch of tuples into an empty relation
+// the file is sized up front for all n tuples, as if they
+//   had been inserted one at a time with the usual splits
+//   (under SPLIT_CHAIN, where those splits can't be known, so
+//   that the tuples would just fill the primary pages),
+// then each bucket is written in one sequential pass:
+//   primary pages in order through the data file,
+//   overflow pages appended in order to the ovflow file
+// every tuple is checked first, so a load that fails leaves the
+//   relation as it was
+
+Status bulkLoadRelation(Reln r, Tuple *tuples, Count n)
+{
+	if (r->ntups != 0 || r->bgsplit || r->wal != NULL) return ~OK;
+	Tuple *given = tuples;
+	if ((tuples = storedBatch(r, given, n)) == NULL) return ~OK;
+	for (Count i = 0; i < n; i++) {
+		if (!fitsInPage(tuples[i], r->format, r->pagesize)) {
+			freeBatch(tuples, given, n);
+			return ~OK; //tuple too big for a page
+		}
+	}
+	resetBufPool(r->pool);
+
+	//work out final shape of the file
+	Count nsplits = 0;
+	BigCount nbytes = 0;
+	for (Count i = 0; i < n; i++) {
+		nbytes += tupleSpace(tuples[i], r->format);
+		if (splitDue(r, i+1, nbytes, r->npages + nsplits)) nsplits++;
+	}
+	if (r->policy == SPLIT_CHAIN) {
+		double cap = pageCapacity(r->format, r->pagesize);
+		while ((r->npages + nsplits)*cap < nbytes) nsplits++;
+	}
+	for (Count i = 0; i < nsplits; i++) advanceSplit(r);
+	r->npages += nsplits;
+	growBuckets(r);
+
+	//hash each tuple once and bucket-sort the batch
+	Bits *hash = malloc(n * sizeof(Bits));
+	PageID *bucket = malloc(n * sizeof(PageID));
+	Count *order = malloc(n * sizeof(Count));
+	Count *start = calloc(r->npages + 1, sizeof(Count));
+	assert(hash != NULL && bucket != NULL && order != NULL && start != NULL);
+	for (Count i = 0; i < n; i++) {
+		hash[i] = tupleHash(r, tuples[i]);
+		bucket[i] = bucketOf(r, hash[i]);
+		start[bucket[i] + 1]++;
+	}
+	for (PageID b = 0; b < r->npages; b++) start[b+1] += start[b];
+	for (Count i = 0; i < n; i++) order[start[bucket[i]]++] = i;
+	//start[b] now marks the end of bucket b
+
+	PageID nextOv = filePages(r->ovflow, r->pagesize);
+	Page pg = newPage(r->pagesize), ovpg = newPage(r->pagesize);
+	Count i = 0;
+	for (PageID b = 0; b < r->npages; b++) {
+		//fill primary page, then chain of overflow pages
+		BucketInfo *bk = hint(r, b);
+		Page cur = pg;
+		FILE *f = r->data;
+		PageID pid = b;
+		initPage(cur, r->pagesize);
+		bk->tail = NO_PAGE;
+		bk->nov = 0;
+		for (; i < start[b]; i++) {
+			Tuple t = tuples[order[i]];
+			Bits h = hash[order[i]];
+			if (addToPage(cur, t, h, r->format, r->pagesize) == OK) continue;
+			pageSetOvflow(cur, nextOv);
+			writePage(f, pid, cur, r->pagesize);
+			f = r->ovflow;
+			pid = bk->tail = nextOv++;
+			bk->nov++;
+			cur = ovpg;
+			initPage(cur, r->pagesize);
+			Status ok = addToPage(cur, t, h, r->format, r->pagesize);
+			assert(ok == OK);
+		}
+		bk->free = pageFreeSpace(cur, r->format, r->pagesize);
+		writePage(f, pid, cur, r->pagesize);
+	}
+	r->ntups = n;
+	r->nbytes = nbytes;
+	r->novpages = nextOv;
+
+	free(pg); free(ovpg);
+	free(hash); free(bucket); free(order); free(start);
+	freeBatch(tuples, given, n);
+	return OK;
+}
+
+// vacuum: repack bucket chains into as few pages as possible
+// while vacuuming, the free list is held as an array, in
+//   decreasing page order, so pages are taken lowest first and
+//   chains move towards the start of the ovflow file
+
+typedef struct {
+	PageID *pids;
+	Count   n, max;
+} FreePages;
+
+static void addFreePage(FreePages *fp, PageID pid)
+{
+	if (fp->n == fp->max) {
+		fp->max = (fp->max == 0) ? 64 : 2*fp->max;
+		fp->pids = realloc(fp->pids, fp->max*sizeof(PageID));
+		assert(fp->pids != NULL);
+	}
+	fp->pids[fp->n++] = pid;
+}
+
+static int cmpPageIDDesc(const void *a, const void *b)
+{
+	PageID x = *(const PageID *)a, y = *(const PageID *)b;
+	return (x > y) ? -1 : (x < y);
+}
+
+// repack the chain of bucket b; freed pages are added to fp
+
+static void vacuumBucket(Reln r, PageID b, FreePages *fp)
+{
+	//copy out the live tuples and give up the overflow pages
+	Count nt = 0, maxt = 64, nold = 0;
+	Tuple *ts = malloc(maxt*sizeof(Tuple));
+	Bits *hs = malloc(maxt*sizeof(Bits));
+	assert(ts != NULL && hs != NULL);
+	FILE *f = r->data;
+	PageID pid = b;
+	while (pid != NO_PAGE) {
+		Page page = pinPage(r->pool, f, pid);
+		char *c = pageData(page);
+		for (Count k = 0; k < pageNTuples(page); k++) {
+			Tuple t = c;
+			if (r->format >= SLOTTED_PAGES)
+				t = pageTuple(page, k, r->format, r->pagesize);
+			else
+				c += strlen(c) + 1;
+			if (nt == maxt) {
+				maxt *= 2;
+				ts = realloc(ts, maxt*sizeof(Tuple));
+				hs = realloc(hs, maxt*sizeof(Bits));
+				assert(ts != NULL && hs != NULL);
+			}
+			hs[nt] = (r->format >= HASHED_PAGES) ? pageTupleHash(page, k, r->format, r->pagesize)
+			                                     : tupleHash(r, t);
+			ts[nt++] = copyString(t);
+		}
+		if (f == r->ovflow) { addFreePage(fp, pid); nold++; }
+		pid = pageOvflow(page);
+		unpinPage(r->pool, page, FALSE);
+		f = r->ovflow;
+	}
+	if (nold > 0) qsort(fp->pids, fp->n, sizeof(PageID), cmpPageIDDesc);
+
+	//write them back, filling each page before taking the next
+	Page page = pinPage(r->pool, r->data, b);
+	initPage(page, r->pagesize);
+	PageID tail = NO_PAGE;
+	Count nov = 0;
+	for (Count i = 0; i < nt; i++) {
+		if (addToPage(page, ts[i], hs[i], r->format, r->pagesize) == OK) continue;
+		PageID next = fp->pids[--fp->n];
+		pageSetOvflow(page, next);
+		unpinPage(r->pool, page, TRUE);
+		page = pinPage(r->pool, r->ovflow, next);
+		initPage(page, r->pagesize);
+		tail = next;
+		nov++;
+		if (addToPage(page, ts[i], hs[i], r->format, r->pagesize) != OK)
+			fatal("tuple insertion during vacuum failed");
+	}
+	BucketInfo *bk = hint(r, b);
+	bk->tail = tail;
+	bk->free = pageFreeSpace(page, r->format, r->pagesize);
+	bk->nov = nov;
+	unpinPage(r->pool, page, TRUE);
+	for (Count i = 0; i < nt; i++) free(ts[i]);
+	free(ts); free(hs);
+}
+
+// add overflow pages that are in no chain and not on the free
+//   list (left behind by older versions of splitRelation) to fp
+
+static void findLostPages(Reln r, FreePages *fp)
+{
+	Count size = filePages(r->ovflow, r->pagesize);
+	Bool *used = calloc(size + 1, sizeof(Bool));
+	assert(used != NULL);
+	for (Count i = 0; i < fp->n; i++) used[fp->pids[i]] = TRUE;
+	for (PageID b = 0; b < r->npages; b++) {
+		Page p = pinPage(r->pool, r->data, b);
+		PageID pid = pageOvflow(p);
+		unpinPage(r->pool, p, FALSE);
+		while (pid != NO_PAGE) {
+			used[pid] = TRUE;
+			p = pinPage(r->pool, r->ovflow, pid);
+			pid = pageOvflow(p);
+			unpinPage(r->pool, p, FALSE);
+		}
+	}
+	for (PageID pid = 0; pid < size; pid++)
+		if (!used[pid]) addFreePage(fp, pid);
+	free(used);
+}
+
+// vacuum up to nbuckets buckets, carrying on from where the
+//   last vacuum stopped, then cut free pages off the end of the
+//   ovflow file and rebuild the free list in page order
+// vacuuming every bucket also reclaims lost overflow pages
+// returns the number of pages the ovflow file shrank by
+
+Count vacuumRelation(Reln r, Count nbuckets)
+{
+	assert(r->mode == 'w' && !r->bgsplit && r->wal == NULL);
+	//pick up the current free list
+	FreePages fp = { NULL, 0, 0 };
+	for (PageID pid = r->freeovf; pid != NO_PAGE; ) {
+		addFreePage(&fp, pid);
+		Page p = pinPage(r->pool, r->ovflow, pid);
+		pid = pageOvflow(p);
+		unpinPage(r->pool, p, FALSE);
+	}
+	if (nbuckets >= r->npages) {
+		nbuckets = r->npages;
+		findLostPages(r, &fp);
+	}
+	if (fp.n > 0) qsort(fp.pids, fp.n, sizeof(PageID), cmpPageIDDesc);
+
+	if (r->vacpos >= r->npages) r->vacpos = 0;
+	for (Count i = 0; i < nbuckets; i++) {
+		vacuumBucket(r, r->vacpos, &fp);
+		r->vacpos = (r->vacpos + 1) % r->npages;
+	}
+
+	//trailing free pages are dropped from the file
+	flushBufPool(r->pool);
+	Count size = filePages(r->ovflow, r->pagesize), oldsize = size;
+	Count k = 0;
+	while (k < fp.n && fp.pids[k] == size-1) { k++; size--; }
+
+	//relink the rest, lowest page first
+	r->freeovf = NO_PAGE;
+	for (Count i = k; i < fp.n; i++) {
+		Page p = pinPage(r->pool, r->ovflow, fp.pids[i]);
+		freeOvflowPage(r, p, fp.pids[i]);
+	}
+	free(fp.pids);
+
+	//no cached copies of the pages being cut off may survive
+	resetBufPool(r->pool);
+	fflush(r->ovflow);
+	if (size < oldsize && ftruncate(fileno(r->ovflow), pageOffset(size, r->pagesize)) != 0)
+		fatal("Can't truncate overflow file");
+	r->novpages = size;
+	return oldsize - size;
+}
+
 // external interfaces for Reln data
 
 FILE *dataFile(Reln r) { return r->data; }
 FILE *ovflowFile(Reln r) { return r->ovflow; }
 Count nattrs(Reln r) { return r->nattrs; }
 Count npages(Reln r) { return r->npages; }
-Count ntuples(Reln r) { return r->ntups; }
+BigCount ntuples(Reln r) { return r->ntups; }
 Count depth(Reln r)  { return r->depth; }
 Count splitp(Reln r) { return r->sp; }
 ChVecItem *chvec(Reln r)  { return r->cv; }
+ChVecPlan chvecPlan(Reln r) { return r->plan; }
+BufPool bufPool(Reln r) { return r->pool; }
+PageFormat pageFormat(Reln r) { return r->format; }
+Count pageSize(Reln r) { return r->pagesize; }
+Dict dictionary(Reln r) { return r->dict; }
+Bits intAttrs(Reln r) { return r->intattrs; }
 
 
 // displays info about open Reln
@@ -321,30 +1607,61 @@ ChVecItem *chvec(Reln r)  { return r->cv; }
 void relationStats(Reln r)
 {
 	printf("Global Info:\n");
-	printf("#attrs:%d  #pages:%d  #tuples:%d  d:%d  sp:%d\n",
-	       r->nattrs, r->npages, r->ntups, r->depth, r->sp);
+	printf("#attrs:%d  #pages:%d  #tuples:%llu  d:%d  sp:%d  format:%s  pagesize:%d\n",
+	       r->nattrs, r->npages, r->ntups, r->depth, r->sp,
+	       formatName(r->format), r->pagesize);
 	printf("Choice vector\n");
 	printChVec(r->cv);
+	if (r->intattrs != 0) {
+		printf("Schema: ");
+		for (Count i = 0; i < r->nattrs; i++)
+			printf("%s%s", (i == 0) ? "" : ",", bitIsSet(r->intattrs, i) ? "int" : "str");
+		putchar('\n');
+	}
+	if (r->dict != NULL) {
+		printf("Dictionaries (attr:#values):");
+		for (Count i = 0; i < r->nattrs; i++)
+			if (bitIsSet(r->dictattrs, i)) printf(" %d:%d", i, dictSize(r->dict, i));
+		putchar('\n');
+	}
 	printf("Bucket Info:\n");
 	printf("%-4s %s\n","#","Info on pages in bucket");
 	printf("%-4s %s\n","","(pageID,#tuples,freebytes,ovflow)");
+	double used = 0;  // space taken by tuples
+	Count nchain = 0; // pages in all bucket chains
 	for (Offset pid = 0; pid < r->npages; pid++) {
 		printf("[%2d]  ",pid);
-		Page p = getPage(r->data, pid);
+		Page p = pinPage(r->pool, r->data, pid);
+		used += pageSpaceUsed(p, r->format);
+		nchain++;
 		Count ntups = pageNTuples(p);
-		Count space = pageFreeSpace(p);
+		Count space = pageFreeSpace(p, r->format, r->pagesize);
 		Offset ovid = pageOvflow(p);
 		printf("(d%d,%d,%d,%d)",pid,ntups,space,ovid);
-		free(p);
+		unpinPage(r->pool, p, FALSE);
 		while (ovid != NO_PAGE) {
 			Offset curid = ovid;
-			p = getPage(r->ovflow, ovid);
+			p = pinPage(r->pool, r->ovflow, ovid);
+			used += pageSpaceUsed(p, r->format);
+			nchain++;
 			ntups = pageNTuples(p);
-			space = pageFreeSpace(p);
+			space = pageFreeSpace(p, r->format, r->pagesize);
 			ovid = pageOvflow(p);
 			printf(" -> (ov%d,%d,%d,%d)",curid,ntups,space,ovid);
-			free(p);
+			unpinPage(r->pool, p, FALSE);
 		}
 		putchar('\n');
 	}
+	printf("Split policy: ");
+	switch (r->policy) {
+	case SPLIT_LOAD:  printf("load factor above %d%%\n", r->param); break;
+	case SPLIT_CHAIN: printf("chains over %d ovflow pages\n", r->param); break;
+	default:          printf("every %d insertions\n", r->param); break;
+	}
+	printf("Load factor: %.2f  Avg chain length: %.2f pages\n",
+	       used/((double)r->npages*pageCapacity(r->format, r->pagesize)),
+	       (double)nchain/r->npages);
+	printf("Buffer pool: %d frames  hits:%d  misses:%d  mapped:%d\n",
+	       poolSize(r->pool), poolHits(r->pool), poolMisses(r->pool),
+	       poolMapped(r->pool));
 }
@@ -8,18 +8,37 @@
 
 typedef struct RelnRep *Reln;
 
+// split policies, as recorded in rel.info
+#define SPLIT_EVERY 1  // after every N insertions
+#define SPLIT_LOAD  2  // when tuples fill more than N% of primary pages
+#define SPLIT_CHAIN 3  // when a chain has more than N overflow pages
+
 #include "defs.h"
 #include "tuple.h"
 #include "page.h"
 #include "chvec.h"
+#include "bufpool.h"
+#include "bits.h"
+#include "dict.h"
 
-Status newRelation(char *name, Count nattr, Count npages, Count d, char *cv);
+Status newRelation(char *name, Count nattr, Count npages, Count d, char *cv,
+                   PageFormat format, Count pagesize, Count policy, Count param,
+                   Bits intattrs, Bits dictattrs);
+Count defaultSplitParam(Count policy, Count nattrs, PageFormat format, Count pagesize);
 Reln openRelation(char *name, char *mode);
 void closeRelation(Reln r);
 Bool existsRelation(char *name);
 PageID addToRelation(Reln r, Tuple t);
+Status addManyToRelation(Reln r, Tuple *ts, Count n);
+Status bulkLoadRelation(Reln r, Tuple *tuples, Count n);
 void splitRelation(Reln r);
-PageID insertIntoPage(Reln r, Tuple t, PageID pid);
+void backgroundSplits(Reln r, Bool on);
+Count splitsOwed(Reln r);
+void logRelation(Reln r, Count interval);
+void commitRelation(Reln r);
+Count vacuumRelation(Reln r, Count nbuckets);
+PageID insertIntoPage(Reln r, Tuple t, Bits h, PageID pid);
+PageID insertManyIntoPage(Reln r, Tuple *ts, Bits *hs, Count n, PageID pid);
 FILE *dataFile(Reln r);
 FILE *ovflowFile(Reln r);
 Count nattrs(Reln r);
@@ -27,6 +46,12 @@ Count npages(Reln r);
 Count depth(Reln r);
 Count splitp(Reln r);
 ChVecItem *chvec(Reln r);
+ChVecPlan chvecPlan(Reln r);
+BufPool bufPool(Reln r);
+PageFormat pageFormat(Reln r);
+Count pageSize(Reln r);
+Dict dictionary(Reln r);
+Bits intAttrs(Reln r);
 void relationStats(Reln r);
 
 #endif
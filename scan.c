@@ -0,0 +1,176 @@
+// scan.c ... page-at-a-time bucket scans
+// part of Multi-attribute Linear-hashed Files
+// Walk the pages of a bucket's chain, and the tuples in each page
+
+#include "defs.h"
+#include "scan.h"
+#include "reln.h"
+#include "page.h"
+#include "bufpool.h"
+#include "pageidx.h"
+#include "prefetch.h"
+
+// A Scan holds one page of a bucket's chain pinned at a time
+// - nextScanPage() moves to the next page in the chain
+// - nextScanTuple() steps through the tuples of the current page
+// Each page is indexed when it is pinned (see pageidx.c), so tuples
+//   and their fields are found without rescanning the bytes
+// Tuples are returned as pointers into the pinned page, so
+//   they are only valid until the scan moves to another page;
+//   use copyTuple() to keep one longer than that
+// A Scan may instead take its pages from a Prefetch, in which
+//   case it walks the chains of all of the prefetched buckets
+// A Scan with a filter passes over pages whose signature shows
+//   they can't hold the values in the filter (see page.c)
+
+struct ScanRep {
+	Reln   rel;      // relation being scanned
+	PageID bucket;   // bucket whose chain we are walking
+	PageID next;     // next page in chain (NO_PAGE at end)
+	Bool   started;  // have we read the primary page yet?
+	Bool   ovflow;   // is current page an overflow page?
+	Page   page;     // current page (pinned), or NULL
+	Prefetch pf;     // source of pages, if prefetching
+	PageFormat fmt;  // layout of pages
+	Count  pagesize; // ... and their size
+	Bits  *filter;   // signature pages must match, or NULL
+	Count  tupno;    // tuples already returned from page
+	Count  nread;    // pages read so far
+	Count  nskipped; // pages passed over by the filter
+	PageIndex ix;    // tuple/comma positions in current page
+};
+
+// set up a scan positioned before the primary page of bucket
+
+Scan startScan(Reln r, PageID bucket)
+{
+	Scan s = malloc(sizeof(struct ScanRep));
+	assert(s != NULL);
+	s->rel = r;
+	s->page = NULL;
+	s->pf = NULL;
+	s->fmt = pageFormat(r);
+	s->pagesize = pageSize(r);
+	s->filter = NULL;
+	s->nread = s->nskipped = 0;
+	resetScan(s, bucket);
+	return s;
+}
+
+// only visit pages that might hold all of the values in sig
+// sig must stay in place until the scan is closed
+
+void scanSetFilter(Scan s, Bits *sig)
+{
+	s->filter = sig;
+}
+
+// set up a scan over all of the buckets being read by pf
+// pages belong to the Prefetch, rather than the buffer pool
+
+Scan startPrefetchScan(Reln r, Prefetch pf)
+{
+	Scan s = startScan(r, NO_PAGE);
+	s->pf = pf;
+	return s;
+}
+
+// give up the current page
+static void releasePage(Scan s)
+{
+	if (s->page != NULL && s->pf == NULL)
+		unpinPage(bufPool(s->rel), s->page, FALSE);
+	s->page = NULL;
+}
+
+// re-position a scan before the primary page of a bucket
+
+void resetScan(Scan s, PageID bucket)
+{
+	assert(s->pf == NULL);
+	releasePage(s);
+	s->bucket = bucket;
+	s->next = bucket;
+	s->started = FALSE;
+	s->ovflow = FALSE;
+	s->tupno = 0;
+}
+
+// move to the next page in the bucket's chain
+// returns FALSE when there are no more pages
+
+Bool nextScanPage(Scan s)
+{
+	for (;;) {
+		releasePage(s);
+		if (s->pf != NULL) {
+			s->page = nextPrefetchPage(s->pf, &s->ovflow);
+			if (s->page == NULL) return FALSE;
+		}
+		else {
+			if (s->next == NO_PAGE) return FALSE;
+			s->ovflow = s->started;
+			FILE *f = s->ovflow ? ovflowFile(s->rel) : dataFile(s->rel);
+			s->page = pinPage(bufPool(s->rel), f, s->next);
+			s->started = TRUE;
+			s->next = pageOvflow(s->page);
+		}
+		s->nread++;
+		if (s->filter == NULL || pageMayMatch(s->page, s->fmt, s->filter, s->pagesize))
+			break;
+		// no tuple here can match; don't bother indexing it
+		s->nskipped++;
+	}
+	s->tupno = 0;
+	indexPage(s->page, &s->ix);
+	return TRUE;
+}
+
+// next tuple in the current page, or NULL at end of page
+
+Tuple nextScanTuple(Scan s)
+{
+	if (s->page == NULL || s->tupno >= s->ix.ntuples)
+		return NULL;
+	return pageData(s->page) + s->ix.start[s->tupno++];
+}
+
+// length of the tuple last returned by nextScanTuple()
+
+Count scanTupleLength(Scan s)
+{
+	assert(s->tupno > 0);
+	return s->ix.start[s->tupno] - s->ix.start[s->tupno-1] - 1;
+}
+
+// views of the fields of the tuple last returned by nextScanTuple()
+// returns the number of fields in the tuple
+
+Count scanTupleAttrs(Scan s, AttrView *vals, Count max)
+{
+	assert(s->tupno > 0);
+	return indexTupleAttrs(&s->ix, s->tupno-1, vals, max);
+}
+
+// composite hash of the tuple last returned by nextScanTuple()
+// returns FALSE if the pages don't hold tuple hashes
+
+Bool scanTupleHash(Scan s, Bits *h)
+{
+	assert(s->tupno > 0);
+	if (s->fmt < HASHED_PAGES) return FALSE;
+	*h = pageTupleHash(s->page, s->tupno-1, s->fmt, s->pagesize);
+	return TRUE;
+}
+
+Bool scanInOvflow(Scan s) { return s->ovflow; }
+Count scanPagesRead(Scan s) { return s->nread; }
+Count scanPagesSkipped(Scan s) { return s->nskipped; }
+
+// release the current page and the scan
+
+void closeScan(Scan s)
+{
+	releasePage(s);
+	free(s);
+}
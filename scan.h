@@ -0,0 +1,29 @@
+// scan.h ... interface to page-at-a-time bucket scans
+// part of Multi-attribute Linear-hashed Files
+// See scan.c for details of Scan type and functions
+
+#ifndef SCAN_H
+#define SCAN_H 1
+
+typedef struct ScanRep *Scan;
+
+#include "defs.h"
+#include "reln.h"
+#include "tuple.h"
+#include "prefetch.h"
+
+Scan startScan(Reln r, PageID bucket);
+Scan startPrefetchScan(Reln r, Prefetch pf);
+void scanSetFilter(Scan s, Bits *sig);
+void resetScan(Scan s, PageID bucket);
+Bool nextScanPage(Scan s);
+Tuple nextScanTuple(Scan s);
+Count scanTupleLength(Scan s);
+Count scanTupleAttrs(Scan s, AttrView *vals, Count max);
+Bool scanTupleHash(Scan s, Bits *h);
+Bool scanInOvflow(Scan s);
+Count scanPagesRead(Scan s);
+Count scanPagesSkipped(Scan s);
+void closeScan(Scan s);
+
+#endif
@@ -1,8 +1,11 @@
 // select.c ... run queries
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named relation
-// Usage:  ./select  [-v]  RelName  v1,v2,v3,v4,...
+// Usage:  ./select  [-v]  [-j N [-o] | -p N]  RelName  v1,v2,v3,v4,...
 // where any of the vi's can be "?" (unknown)
+// -j N scans candidate buckets with N worker threads
+// -o   with -j, gives results in bucket order
+// -p N reads up to N candidate buckets ahead of the scan
 
 #include "defs.h"
 #include "query.h"
@@ -10,7 +13,7 @@
 #include "reln.h"
 #include "chvec.h"
 
-#define USAGE "./select  [-v]  RelName  v1,v2,v3,v4,..."
+#define USAGE "./select  [-v]  [-j N [-o] | -p N]  RelName  v1,v2,v3,v4,..."
 
 // Main ... process args, run query
 
@@ -20,21 +23,34 @@ int main(int argc, char **argv)
 	Query q;  // processed version of query string
 	Tuple t;  // tuple pointer
 	char err[MAXERRMSG];  // buffer for error messages
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
+	int nworkers = 0;  // scan in parallel with this many threads
+	int ordered = 0;  // keep parallel results in bucket order
+	int prefetch = 0;  // buckets to read ahead of the scan
 	char *rname;  // name of table/file
 	char *qstr;   // query string
 
 	// process command-line args
 
-	if (argc < 3) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		verbose = 1;  rname = argv[2];  qstr = argv[3];
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[a], "-o") == 0)
+			ordered = 1;
+		else if (strcmp(argv[a], "-j") == 0 && a+1 < argc) {
+			nworkers = atoi(argv[++a]);
+			if (nworkers < 1) fatal(USAGE);
+		}
+		else if (strcmp(argv[a], "-p") == 0 && a+1 < argc) {
+			prefetch = atoi(argv[++a]);
+			if (prefetch < 1) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
 	}
-	else {
-		verbose = 0;  rname = argv[1];  qstr = argv[2];
-	}
-
-	if (verbose) { /* keeps compiler quiet */ }
+	if (a+1 >= argc || (nworkers > 0 && prefetch > 0)) fatal(USAGE);
+	rname = argv[a];  qstr = argv[a+1];
 
 	// initialise relation and scanning structure
 
@@ -50,14 +66,23 @@ int main(int argc, char **argv)
 		sprintf(err, "Invalid query: %s",qstr);
 		fatal(err);
 	}
+	if (nworkers > 0) parallelQuery(q, nworkers, ordered);
+	if (prefetch > 0) prefetchQuery(q, prefetch);
 
 	// execute the query (find matching tuples)
 
 	char tup[MAXTUPLEN];
 	while ((t = getNextTuple(q)) != NULL) {
-		tupleString(t,tup);
+		showTuple(r,t,tup);
 		printf("%s\n",tup);
 	}
+	if (verbose) {
+		Count nread = queryPagesRead(q), nskip = queryPagesSkipped(q);
+		printf("Pages read: %d\n", nread);
+		printf("Pages skipped: %d (%d%%)\n", nskip,
+		       (nread == 0) ? 0 : 100*nskip/nread);
+		if (prefetch > 0) printf("Prefetch stalls: %d\n", queryStalls(q));
+	}
 
 	// clean up
 
@@ -8,6 +8,55 @@
 #include "hash.h"
 #include "chvec.h"
 #include "bits.h"
+#include "dict.h"
+#include <ctype.h>
+#include <limits.h>
+
+// attributes are strings, unless the relation says they are ints
+// an int attribute is stored in INTLEN bytes: its value, offset so
+//   that INT_MIN is 0, in 7-bit groups, most significant first,
+//   each with the top bit set; no byte is '\0' or ',' (or any other
+//   ASCII), so a stored int is still a field of a comma-separated
+//   string, and stored ints sort as their values do
+// ints are hashed by value (hash_uint32) and compared as one word;
+//   they are converted from text when tuples are stored or queries
+//   started, and back to text only when tuples are shown
+
+static Bool isInt(Reln r, Count att)
+{
+	return att < MAXATTRS && bitIsSet(intAttrs(r), att);
+}
+
+// the offset value of the int in the text val, if there is one
+
+static Bool parseInt(char *val, Count len, Bits *u)
+{
+	char buf[16], *end;
+	if (len == 0 || len >= sizeof buf) return FALSE;
+	memcpy(buf, val, len);
+	buf[len] = '\0';
+	if (!isdigit((unsigned char)buf[0]) && buf[0] != '-') return FALSE;
+	long long v = strtoll(buf, &end, 10);
+	if (end == buf || *end != '\0' || v < INT_MIN || v > INT_MAX) return FALSE;
+	*u = (Bits)(int)v ^ 0x80000000;
+	return TRUE;
+}
+
+static void packInt(Bits u, char *out)
+{
+	for (int i = INTLEN-1; i >= 0; i--) {
+		out[i] = 0x80 | (u & 0x7F);
+		u >>= 7;
+	}
+}
+
+static Bits unpackInt(char *in)
+{
+	Bits u = 0;
+	for (int i = 0; i < INTLEN; i++)
+		u = (u << 7) | (in[i] & 0x7F);
+	return u;
+}
 
 // return number of bytes/chars in a tuple
 
@@ -31,51 +80,52 @@ Tuple readTuple(Reln r, FILE *in)
 		if (*c == ',') nf++;
 	// invalid tuple
 	if (nf != nattrs(r)) return NULL;
+	if (intAttrs(r) != 0) {
+		// ... or an int attribute that isn't an int
+		AttrView v[nf];
+		tupleAttrs(line, v, nf);
+		Bits u;
+		for (int i = 0; i < nf; i++)
+			if (isInt(r, i) && !parseInt(line + v[i].off, v[i].len, &u)) return NULL;
+	}
 	return copyString(line); // needs to be free'd sometime
 }
 
-Tuple nextTuple(FILE *in,PageID pid,Offset currTup)
-{
-	char tuple[MAXTUPLEN];
-	//positionBase = pages * pagesize + 2*sizeof(int) for offset + 1*sizeof(int) for count
-	//by keeping sizeof(Offset) instead of using sizeof(int), keep future development simple
-	Offset postionBase = PAGESIZE * pid + 2 * sizeof(Offset) + sizeof(Count);
-
-	//from the start of file, move to postionBase + current tuple
-	fseek(in, postionBase + currTup, SEEK_SET);
-	// save to file *in
-	fgets(tuple, MAXTUPLEN - 1, in);
-
-	//count how many fields we have
-	char *i;
-	int numberOfFields = 1;
-	//start from the first, stop if empty
-	for (i = tuple; *i !='\0'; i++)
-	    //if find , so it is a seperate field. 
-	    if(*i ==',')
-	        numberOfFields++;
-	return copyString(tuple); // needed to be free later
-}
-// extract values into an array of strings
+// locate the attribute values in a tuple without copying them
+// fills in up to max views; returns the number of fields in t
+// tuple is never modified, since it may be in a read-only page
 
-void tupleVals(Tuple t, char **vals)
+Count tupleAttrs(Tuple t, AttrView *vals, Count max)
 {
 	char *c = t, *c0 = t;
-	int i = 0;
+	Count i = 0;
 	for (;;) {
 		while (*c != ',' && *c != '\0') c++;
-		if (*c == '\0') {
-			// end of tuple; add last field to vals
-			vals[i++] = copyString(c0);
-			break;
-		}
-		else {
-			// end of next field; add to vals
-			*c = '\0';
-			vals[i++] = copyString(c0);
-			*c = ',';
-			c++; c0 = c;
+		if (i < max) {
+			vals[i].off = c0 - t;
+			vals[i].len = c - c0;
 		}
+		i++;
+		// end of tuple; last field found
+		if (*c == '\0') break;
+		c++; c0 = c;
+	}
+	return i;
+}
+
+// extract values into an array of strings
+// kept for callers that need separate copies of the values
+
+void tupleVals(Tuple t, char **vals)
+{
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	for (Count i = 0; i < n; i++) {
+		vals[i] = malloc(v[i].len+1);
+		assert(vals[i] != NULL);
+		memcpy(vals[i], t + v[i].off, v[i].len);
+		vals[i][v[i].len] = '\0';
 	}
 }
 
@@ -88,49 +138,20 @@ void freeVals(char **vals, int nattrs)
 }
 
 // hash a tuple using the choice vector
-// TODO: actually use the choice vector to make the hash
+// per-attribute hashes are combined by the relation's compiled ChVec
 
 Bits tupleHash(Reln r, Tuple t)
 {
-	char buf[MAXBITS+1];
 	Count nvals = nattrs(r);
-	char **vals = malloc(nvals*sizeof(char *));
-	assert(vals != NULL);
-	tupleVals(t, vals);
+	AttrView vals[nvals];
+	tupleAttrs(t, vals, nvals);
 	Bits hash[nvals];
 
 	//hash each attribute, store in hash
-	for (int i = 0; i < nvals; i++) {
-		hash[i] = hash_any((unsigned char *)vals[i], strlen(vals[i]));
-		bitsString(hash[i], buf);
-		//printf("hash(%s) = %s\n", vals[i], buf);
-	}
+	for (int i = 0; i < nvals; i++)
+		hash[i] = attrHash(r, i, t + vals[i].off, vals[i].len);
 
-	//use choice vector to insert bits
-	ChVecItem * choiceVector = chvec(r); //get choice vector from relation
-	char newBuf[MAXBITS+1]; //new hash buffer with cv
-	for (int i = 0; i < MAXBITS; i++) { //for each bit from cv
-		Byte attr = choiceVector[i].att;
-		Byte bit = choiceVector[i].bit;
-		bitsString(hash[attr], buf);
-		//remove space
-		int j = 0, k = 0;
-		for (j = 0; buf[j] != '\0'; j++)
-			if (buf[j] != ' ')
-				buf[k++] = buf[j];
-		newBuf[MAXBITS-1-i] = buf[MAXBITS-1-bit]; //store relative bit in newBuffer
-	}
-
-	//newBuffer into hash bits
-	Bits result = 0;
-	for (int i = 0; i < MAXBITS; i++)
-		if (newBuf[i] == '1')
-			result = setBit(result, MAXBITS-1-i); //reverse storage of result
-
-	bitsString(result, buf);
-	printf("Choice Vector hash value of (%s): %s\n", vals[0], buf);
-
-	return result;
+	return chvecHash(chvecPlan(r), hash);
 }
 
 // compare two tuples (allowing for "unknown" values)
@@ -138,20 +159,24 @@ Bits tupleHash(Reln r, Tuple t)
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
 {
 	Count na = nattrs(r);
-	char **v1 = malloc(na*sizeof(char *));
-	tupleVals(t1, v1);
-	char **v2 = malloc(na*sizeof(char *));
-	tupleVals(t2, v2);
-	Bool match = TRUE;
-	int i;
-	for (i = 0; i < na; i++) {
+	AttrView v1[na], v2[na];
+	tupleAttrs(t1, v1, na);
+	tupleAttrs(t2, v2, na);
+	for (int i = 0; i < na; i++) {
+		char *a1 = t1 + v1[i].off, *a2 = t2 + v2[i].off;
 		// assumes no real attribute values start with '?'
-		if (v1[i][0] == '?' || v2[i][0] == '?') continue;
-		if (strcmp(v1[i],v2[i]) == 0) continue;
-		match = FALSE;
+		if (a1[0] == '?' || a2[0] == '?') continue;
+		if (v1[i].len != v2[i].len || memcmp(a1, a2, v1[i].len) != 0)
+			return FALSE;
 	}
-	freeVals(v1,na); freeVals(v2,na);
-	return match;
+	return TRUE;
+}
+
+// make a private copy of a tuple borrowed from a page
+
+Tuple copyTuple(Tuple t)
+{
+	return copyString(t); // needs to be free'd sometime
 }
 
 // puts printable version of tuple in user-supplied buffer
@@ -160,3 +185,75 @@ void tupleString(Tuple t, char *buf)
 {
 	strcpy(buf,t);
 }
+
+// hash the stored value val of attribute att
+
+Bits attrHash(Reln r, Count att, char *val, Count len)
+{
+	if (isInt(r, att) && len == INTLEN) return hash_uint32(unpackInt(val));
+	return hash_any((unsigned char *)val, len);
+}
+
+// the stored form of the int attributes of text tuple t
+// in a query, "?" is left as it is
+// returns a new tuple, which the caller frees, or NULL if an int
+//   attribute isn't an int
+
+Tuple packTuple(Reln r, Tuple t, Bool query)
+{
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	Tuple p = malloc(strlen(t) + n*INTLEN + 1);
+	assert(p != NULL);
+	char *c = p;
+	for (Count i = 0; i < n; i++) {
+		char *val = t + v[i].off;
+		Count len = v[i].len;
+		Bits u;
+		if (i > 0) *c++ = ',';
+		if (!isInt(r, i) || (query && len == 1 && val[0] == '?')) {
+			memcpy(c, val, len);
+			c += len;
+		}
+		else if (parseInt(val, len, &u)) {
+			packInt(u, c);
+			c += INTLEN;
+		}
+		else {
+			free(p);
+			return NULL;
+		}
+	}
+	*c = '\0';
+	return p;
+}
+
+// put the text version of stored tuple t in buf (of MAXTUPLEN)
+
+void showTuple(Reln r, Tuple t, char *buf)
+{
+	char plain[MAXSTOREDLEN];
+	if (dictionary(r) != NULL) {
+		decodeTuple(dictionary(r), t, plain);
+		t = plain;
+	}
+	if (intAttrs(r) == 0) {
+		tupleString(t, buf);
+		return;
+	}
+	Count n = tupleAttrs(t, NULL, 0);
+	AttrView v[n];
+	tupleAttrs(t, v, n);
+	char *c = buf;
+	for (Count i = 0; i < n; i++) {
+		if (i > 0) *c++ = ',';
+		if (isInt(r, i) && v[i].len == INTLEN)
+			c += sprintf(c, "%d", (int)(unpackInt(t + v[i].off) ^ 0x80000000));
+		else {
+			memcpy(c, t + v[i].off, v[i].len);
+			c += v[i].len;
+		}
+	}
+	*c = '\0';
+}
@@ -13,13 +13,25 @@ typedef char *Tuple;
 #include "reln.h"
 #include "bits.h"
 
+// int attributes are stored as INTLEN bytes (see tuple.c), so a
+//   stored tuple may be a little longer than its text form
+#define INTLEN 5
+#define MAXSTOREDLEN (MAXTUPLEN + MAXATTRS*INTLEN)
+
+// location of one attribute value within a tuple
+typedef struct { Offset off; Count len; } AttrView;
+
 int tupLength(Tuple t);
 Tuple readTuple(Reln r, FILE *in);
 Bits tupleHash(Reln r, Tuple t);
+Count tupleAttrs(Tuple t, AttrView *vals, Count max);
 void tupleVals(Tuple t, char **vals);
 void freeVals(char **vals, int nattrs);
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2);
+Tuple copyTuple(Tuple t);
 void tupleString(Tuple t, char *buf);
+Bits attrHash(Reln r, Count att, char *val, Count len);
+Tuple packTuple(Reln r, Tuple t, Bool query);
+void showTuple(Reln r, Tuple t, char *buf);
 
-Tuple nextTuple(FILE *in,PageID pid,Offset currTup);
 #endif
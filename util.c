@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 void fatal(char *msg)
 {
@@ -20,3 +21,12 @@ char *copyString(char *str)
 	strcpy(new, str);
 	return new;
 }
+
+// seconds on a monotonic clock, for timing intervals
+
+double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
@@ -0,0 +1,52 @@
+// vacuum.c ... repack overflow chains of a Relation
+// part of Multi-attribute linear-hashed files
+// Squeeze each bucket's chain into the fewest pages
+// Usage:  ./vacuum  [-v]  [-n #buckets]  RelName
+// -n vacuums at most #buckets buckets, starting where
+//    the previous vacuum of the relation stopped
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./vacuum  [-v]  [-n #buckets]  RelName"
+
+// Main ... process args, vacuum relation
+
+int main(int argc, char **argv)
+{
+	int verbose = 0;  // show what was done
+	int nbuckets = -1;  // how many buckets to vacuum (all)
+
+	// process command-line args
+
+	int a;
+	for (a = 1; a < argc && argv[a][0] == '-'; a++) {
+		if (strcmp(argv[a], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+			nbuckets = atoi(argv[++a]);
+			if (nbuckets < 1) fatal(USAGE);
+		}
+		else
+			fatal(USAGE);
+	}
+	if (a >= argc) fatal(USAGE);
+	char *relname = argv[a];
+
+	// open relation and vacuum it
+
+	if (!existsRelation(relname))
+		fatal("No such relation");
+	Reln r = openRelation(relname,"r+");
+	if (r == NULL)
+		fatal("Can't open relation");
+	if (nbuckets < 0 || nbuckets > npages(r)) nbuckets = npages(r);
+
+	Count shrunk = vacuumRelation(r, nbuckets);
+	if (verbose)
+		printf("Vacuumed %d buckets; ovflow file shrank by %d pages\n",
+		       nbuckets, shrunk);
+	closeRelation(r);
+
+	return 0;
+}
@@ -0,0 +1,266 @@
+// wal.c ... a relation's write-ahead log
+// part of Multi-attribute Linear-hashed Files
+// Redo log of page images and header updates, kept in rel.wal
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "defs.h"
+#include "wal.h"
+#include "page.h"
+#include "hash.h"
+
+// A WAL holds the changes made to a relation since its last
+//   checkpoint, so that its data files only ever hold a state
+//   the relation has committed
+// - while a relation is logged, modified pages written back by
+//   the buffer pool go to the log (logPage()), not to the data
+//   files; a page later read back in is taken from the log if it
+//   is there (loggedPage())
+// - a commit logs the header (ntups, sp, depth, ...) after any
+//   pages written since the last commit, then the log is synced,
+//   so one fsync covers every insert in the group
+// - a checkpoint copies the latest image of each logged page into
+//   the data files (applyWAL()), syncs them, and empties the log
+// - after a crash, replayWAL() copies the pages of each complete
+//   group into the data files, and hands back the last header;
+//   a group cut short by the crash is ignored
+// - every record carries a checksum, so a torn write at the end
+//   of the log just ends the replay
+
+#define WAL_PAGE   1  // image of a page
+#define WAL_COMMIT 2  // header at the end of a group
+
+typedef struct {
+	Count  kind;   // WAL_PAGE or WAL_COMMIT
+	Count  file;   // 0 for the data file, 1 for ovflow (pages)
+	PageID pid;    // page id (pages), #pages in group (commits)
+	Count  len;    // bytes following the record
+	Bits   check;  // hash of the record and the bytes following
+} WALRec;
+
+struct WALRep {
+	int    fd;       // descriptor of rel.wal
+	FILE  *files[2]; // data and ovflow files of the relation
+	Count  pagesize; // bytes in each page of the files
+	off_t  end;      // where the next record goes
+	Count  ngroup;   // pages logged since the last commit
+	off_t *where[2]; // offset of latest image of each page, or -1
+	Count  nwhere[2];
+	pthread_mutex_t lock;
+};
+
+static Bits recCheck(WALRec *rec, void *body)
+{
+	Bits h = hash_any((unsigned char *)rec, sizeof(WALRec) - sizeof(Bits));
+	return h ^ hash_any(body, rec->len);
+}
+
+static Count fileNo(WAL w, FILE *f)
+{
+	assert(f == w->files[0] || f == w->files[1]);
+	return (f == w->files[0]) ? 0 : 1;
+}
+
+// is there anything in a relation's log?
+
+Bool walPending(char *name)
+{
+	char fname[MAXFILENAME];
+	struct stat st;
+	sprintf(fname,"%s.wal",name);
+	return stat(fname, &st) == 0 && st.st_size > 0;
+}
+
+// open (or create) the log of a relation whose pages (of pagesize
+//   bytes) are in data and ovflow; the log is read from the start
+//   by replayWAL(), or else written from the start
+
+WAL openWAL(char *name, FILE *data, FILE *ovflow, Count pagesize)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.wal",name);
+	WAL w = malloc(sizeof(struct WALRep));
+	assert(w != NULL);
+	w->fd = open(fname, O_RDWR|O_CREAT, 0644);
+	if (w->fd < 0) fatal("Can't open log file");
+	w->files[0] = data; w->files[1] = ovflow;
+	w->pagesize = pagesize;
+	w->end = 0;
+	w->ngroup = 0;
+	for (int i = 0; i < 2; i++) { w->where[i] = NULL; w->nwhere[i] = 0; }
+	pthread_mutex_init(&w->lock, NULL);
+	return w;
+}
+
+void closeWAL(WAL w)
+{
+	close(w->fd);
+	free(w->where[0]); free(w->where[1]);
+	pthread_mutex_destroy(&w->lock);
+	free(w);
+}
+
+// append a record; caller holds lock
+
+static void append(WAL w, WALRec *rec, void *body)
+{
+	char buf[sizeof(WALRec) + rec->len];
+	rec->check = recCheck(rec, body);
+	memcpy(buf, rec, sizeof(WALRec));
+	memcpy(buf + sizeof(WALRec), body, rec->len);
+	ssize_t n = pwrite(w->fd, buf, sizeof buf, w->end);
+	if (n != sizeof buf) fatal("Can't write log");
+	w->end += sizeof buf;
+}
+
+// log the current contents of page pid of file f
+
+void logPage(WAL w, FILE *f, PageID pid, Page p)
+{
+	Count i = fileNo(w, f);
+	WALRec rec = { WAL_PAGE, i, pid, w->pagesize, 0 };
+	pthread_mutex_lock(&w->lock);
+	if (pid >= w->nwhere[i]) {
+		Count n = (w->nwhere[i] == 0) ? 1024 : w->nwhere[i];
+		while (n <= pid) n *= 2;
+		w->where[i] = realloc(w->where[i], n*sizeof(off_t));
+		assert(w->where[i] != NULL);
+		for (Count k = w->nwhere[i]; k < n; k++) w->where[i][k] = -1;
+		w->nwhere[i] = n;
+	}
+	w->where[i][pid] = w->end;
+	append(w, &rec, p);
+	w->ngroup++;
+	pthread_mutex_unlock(&w->lock);
+}
+
+// read the latest logged image of page pid of file f, if any
+
+Bool loggedPage(WAL w, FILE *f, PageID pid, Page p)
+{
+	Count i = fileNo(w, f);
+	pthread_mutex_lock(&w->lock);
+	off_t at = (pid < w->nwhere[i]) ? w->where[i][pid] : -1;
+	pthread_mutex_unlock(&w->lock);
+	if (at < 0) return FALSE;
+	ssize_t n = pread(w->fd, p, w->pagesize, at + sizeof(WALRec));
+	assert(n == w->pagesize);
+	return TRUE;
+}
+
+// end a group with the header hdr; syncWAL() makes it durable
+
+void logCommit(WAL w, void *hdr, Count len)
+{
+	pthread_mutex_lock(&w->lock);
+	WALRec rec = { WAL_COMMIT, 0, w->ngroup, len, 0 };
+	append(w, &rec, hdr);
+	w->ngroup = 0;
+	pthread_mutex_unlock(&w->lock);
+}
+
+void syncWAL(WAL w)
+{
+	if (fsync(w->fd) != 0) fatal("Can't sync log");
+}
+
+// bytes in the log
+
+off_t walSize(WAL w)
+{
+	pthread_mutex_lock(&w->lock);
+	off_t n = w->end;
+	pthread_mutex_unlock(&w->lock);
+	return n;
+}
+
+// read the record at pos, and its body into buf (of max bytes)
+// returns FALSE at the end of the log or at a damaged record
+
+static Bool readRec(WAL w, off_t pos, WALRec *rec, void *buf, Count max)
+{
+	if (pread(w->fd, rec, sizeof(WALRec), pos) != sizeof(WALRec)) return FALSE;
+	if (rec->len > max) return FALSE;
+	if (pread(w->fd, buf, rec->len, pos + sizeof(WALRec)) != rec->len) return FALSE;
+	return rec->check == recCheck(rec, buf);
+}
+
+static void syncFiles(WAL w)
+{
+	for (int i = 0; i < 2; i++) {
+		fflush(w->files[i]);
+		if (fsync(fileno(w->files[i])) != 0) fatal("Can't sync relation");
+	}
+}
+
+// redo each complete group in the log, in order
+// hdr gets the header (of len bytes) of the last group
+// returns TRUE if there was a complete group
+
+Bool replayWAL(WAL w, void *hdr, Count len)
+{
+	char buf[w->pagesize > len ? w->pagesize : len];
+	WALRec rec;
+	off_t pos = 0, group = 0;
+	Count n = 0;
+	Bool found = FALSE;
+	while (readRec(w, pos, &rec, buf, sizeof buf)) {
+		pos += sizeof(WALRec) + rec.len;
+		if (rec.kind == WAL_PAGE) {
+			if (rec.len != w->pagesize || rec.file > 1) break;
+			n++;
+			continue;
+		}
+		if (rec.kind != WAL_COMMIT || rec.pid != n || rec.len != len) break;
+		memcpy(hdr, buf, len);
+		// group is complete; copy its pages to the data files
+		while (group < pos) {
+			readRec(w, group, &rec, buf, sizeof buf);
+			if (rec.kind == WAL_PAGE)
+				writePage(w->files[rec.file], rec.pid, (Page)buf, w->pagesize);
+			group += sizeof(WALRec) + rec.len;
+		}
+		n = 0;
+		found = TRUE;
+	}
+	if (found) syncFiles(w);
+	return found;
+}
+
+// copy the latest image of every logged page to the data files,
+//   and sync them
+// the log must end with a commit
+
+void applyWAL(WAL w)
+{
+	char buf[w->pagesize];
+	pthread_mutex_lock(&w->lock);
+	assert(w->ngroup == 0);
+	for (int i = 0; i < 2; i++) {
+		for (PageID pid = 0; pid < w->nwhere[i]; pid++) {
+			off_t at = w->where[i][pid];
+			if (at < 0) continue;
+			ssize_t n = pread(w->fd, buf, w->pagesize, at + sizeof(WALRec));
+			assert(n == w->pagesize);
+			writePage(w->files[i], pid, (Page)buf, w->pagesize);
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	syncFiles(w);
+}
+
+// empty the log, once the data files hold all it records
+
+void resetWAL(WAL w)
+{
+	pthread_mutex_lock(&w->lock);
+	if (ftruncate(w->fd, 0) != 0) fatal("Can't truncate log");
+	syncWAL(w);
+	w->end = 0;
+	w->ngroup = 0;
+	for (int i = 0; i < 2; i++)
+		for (PageID pid = 0; pid < w->nwhere[i]; pid++) w->where[i][pid] = -1;
+	pthread_mutex_unlock(&w->lock);
+}
@@ -0,0 +1,25 @@
+// wal.h ... interface to a relation's write-ahead log
+// part of Multi-attribute Linear-hashed Files
+// See wal.c for details of WAL type and functions
+
+#ifndef WAL_H
+#define WAL_H 1
+
+typedef struct WALRep *WAL;
+
+#include "defs.h"
+#include "page.h"
+
+Bool walPending(char *name);
+WAL openWAL(char *name, FILE *data, FILE *ovflow, Count pagesize);
+void closeWAL(WAL w);
+void logPage(WAL w, FILE *f, PageID pid, Page p);
+Bool loggedPage(WAL w, FILE *f, PageID pid, Page p);
+void logCommit(WAL w, void *hdr, Count len);
+void syncWAL(WAL w);
+off_t walSize(WAL w);
+Bool replayWAL(WAL w, void *hdr, Count len);
+void applyWAL(WAL w);
+void resetWAL(WAL w);
+
+#endif